@@ -36,14 +36,18 @@
 
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <gpiod.h>
 #include <ifaddrs.h>
+#include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,15 +56,26 @@
 #include <unistd.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/ip_icmp.h>
 #include <signal.h>
 #include <sysexits.h>
 #include <linux/types.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <linux/rtnetlink.h>
 #include <linux/spi/spidev.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/timex.h>
+#include <sys/un.h>
 
 static const uint16_t font[][16] = {
     {0x0000, 0x0E00, 0x1B00, 0x3180, 0x3180, 0x1B00, 0x0E00, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,}, /* ° */
@@ -256,6 +271,10 @@ static const uint16_t font[][16] = {
 #define ST7789_PORTRAIT_ROT180  0x00
 #define ST7789_LANDSCAPE        ST7789_MADCTL_MX | ST7789_MADCTL_MV | ST7789_MADCTL_ML
 #define ST7789_LANDSCAPE_ROT180 ST7789_MADCTL_MY | ST7789_MADCTL_MV
+#define ST7789_COLMOD_16BIT     0x05    /* RGB 5-6-5, two bytes per pixel                                                       */
+#define ST7789_COLMOD_12BIT     0x03    /* RGB 4-4-4, three bytes per pair of pixels                                            */
+#define SPI_CHUNK_SIZE          4096    /* Bytes of each SPI transfer                                                           */
+#define SPI_PIXEL_PAIRS         1365    /* Pixel pairs packed in each 12 bit transfer, a multiple of 3 bytes under the chunk   */
 
 #define FONT_WIDTH              11
 #define FONT_HEIGHT             16
@@ -264,118 +283,623 @@ static const uint16_t font[][16] = {
 
 #define MAX_CHARS_IN_LINE       SCREEN_WIDTH / FONT_WIDTH //29
 
-#define NAME_DATA_Y1            16
+#define PANEL_WIDTH             (layout->width)
+#define PANEL_HEIGHT            (layout->height)
+#define PANEL_CENTER_X          (PANEL_WIDTH / 2)
+#define LAYOUT_HIDDEN           SCREEN_WIDTH    /* Position of the fields a layout has no room for, they are never drawn   */
+#define LAYOUT_TITLE            0
+#define LAYOUT_NET              1
+#define LAYOUT_LEFT             2
+#define LAYOUT_RIGHT            3
+#define LAYOUT_DETAIL           4
+#define LAYOUT_BOXES            5
+
+#define NAME_DATA_Y1            (layout->name_y)
 
 #define TIME_DATA_LENGHT        19
 #define TIME_DATA_WIDTH         FONT_WIDTH * TIME_DATA_LENGHT
-#define TIME_DATA_X1            58
+#define TIME_DATA_X1            (layout->time_x)
 #define TIME_DATA_X2            TIME_DATA_X1 + TIME_DATA_WIDTH
-#define TIME_DATA_Y1            38
+#define TIME_DATA_Y1            (layout->time_y)
 #define TIME_DATA_Y2            TIME_DATA_Y1 + FONT_HEIGHT
 
-#define NET1_LABEL_X            22
-#define NET1_LABEL_Y            69
-#define NET1_DATA_X             82
-#define NET1_DATA_Y             91
-#define NET2_LABEL_X            22
-#define NET2_LABEL_Y            113
-#define NET2_DATA_X             82
-#define NET2_DATA_Y             135
-#define NET_LABEL_RX_X          170
-#define NET_LABEL_TX_X          276
+#define NET1_LABEL_X            (layout->net_label_x)
+#define NET1_LABEL_Y            (layout->net1_label_y)
+#define NET1_DATA_Y             (layout->net1_data_y)
+#define NET2_LABEL_X            (layout->net_label_x)
+#define NET2_LABEL_Y            (layout->net2_label_y)
+#define NET2_DATA_Y             (layout->net2_data_y)
+#define NET_LABEL_RX_X          (layout->net_rx_label_x)
+#define NET_LABEL_TX_X          (layout->net_tx_label_x)
 #define NET_DATA_LENGHT         4
 #define NET_DATA_WIDTH          FONT_WIDTH * NET_DATA_LENGHT
 
-#define IFDEV1_RX_DATA_X1       126
+#define IFDEV1_RX_DATA_X1       (layout->net_rx_data_x)
 #define IFDEV1_RX_DATA_X2       IFDEV1_RX_DATA_X1 + NET_DATA_WIDTH
 #define IFDEV1_RX_DATA_Y1       NET1_LABEL_Y
 #define IFDEV1_RX_DATA_Y2       IFDEV1_RX_DATA_Y1 + FONT_HEIGHT
 
-#define IFDEV1_TX_DATA_X1       232
+#define IFDEV1_TX_DATA_X1       (layout->net_tx_data_x)
 #define IFDEV1_TX_DATA_X2       IFDEV1_TX_DATA_X1 + NET_DATA_WIDTH
 #define IFDEV1_TX_DATA_Y1       NET1_LABEL_Y
 #define IFDEV1_TX_DATA_Y2       IFDEV1_TX_DATA_Y1 + FONT_HEIGHT
 
-#define IFDEV2_RX_DATA_X1       126
+#define IFDEV2_RX_DATA_X1       (layout->net_rx_data_x)
 #define IFDEV2_RX_DATA_X2       IFDEV2_RX_DATA_X1 + NET_DATA_WIDTH
 #define IFDEV2_RX_DATA_Y1       NET2_LABEL_Y
 #define IFDEV2_RX_DATA_Y2       IFDEV2_RX_DATA_Y1 + FONT_HEIGHT
 
-#define IFDEV2_TX_DATA_X1       232
+#define IFDEV2_TX_DATA_X1       (layout->net_tx_data_x)
 #define IFDEV2_TX_DATA_X2       IFDEV2_TX_DATA_X1 + NET_DATA_WIDTH
 #define IFDEV2_TX_DATA_Y1       NET2_LABEL_Y
 #define IFDEV2_TX_DATA_Y2       IFDEV2_TX_DATA_Y1 + FONT_HEIGHT
 
-#define CPU_LABEL_X1            22
+#define CPU_LABEL_X1            (layout->left_label_x)
 #define CPU_DATA_LENGHT         4
 #define CPU_DATA_WIDTH          FONT_WIDTH * CPU_DATA_LENGHT
-#define CPU_DATA_X1             65
+#define CPU_DATA_X1             (layout->left_data_x)
 #define CPU_DATA_X2             CPU_DATA_X1 + CPU_DATA_WIDTH
-#define CPU_DATA_Y1             166
+#define CPU_DATA_Y1             (layout->row_y[0])
 #define CPU_DATA_Y2             CPU_DATA_Y1 + FONT_HEIGHT
 
-#define RAM_LABEL_X1            22
+#define RAM_LABEL_X1            (layout->left_label_x)
 #define RAM_DATA_LENGHT         4
 #define RAM_DATA_WIDTH          FONT_WIDTH * RAM_DATA_LENGHT
-#define RAM_DATA_X1             65
+#define RAM_DATA_X1             (layout->left_data_x)
 #define RAM_DATA_X2             RAM_DATA_X1 + RAM_DATA_WIDTH
-#define RAM_DATA_Y1             188
+#define RAM_DATA_Y1             (layout->row_y[1])
 #define RAM_DATA_Y2             RAM_DATA_Y1 + FONT_HEIGHT
+#define RAM_FLAG_X1             (layout->flag_x)
 
-#define TEMP_LABEL_X1           22
-#define TEMP_FIXED_X1           99
-#define TEMP_DATA_LENGHT        2
+#define TEMP_LABEL_X1           (layout->left_label_x)
+#define TEMP_FIXED_X1           (layout->temp_fixed_x)
+#define TEMP_FLAG_X1            (layout->flag_x)
+#define TEMP_DATA_LENGHT        3
 #define TEMP_DATA_WIDTH         FONT_WIDTH * TEMP_DATA_LENGHT
-#define TEMP_DATA_X1            76
+#define TEMP_DATA_X1            (layout->temp_data_x)
 #define TEMP_DATA_X2            TEMP_DATA_X1 + TEMP_DATA_WIDTH
-#define TEMP_DATA_Y1            210
+#define TEMP_DATA_Y1            (layout->row_y[2])
 #define TEMP_DATA_Y2            TEMP_DATA_Y1 + FONT_HEIGHT
 
-#define UPT_LABEL_X1            140
+#define UPT_LABEL_X1            (layout->upt_label_x)
 #define UPT_DATA_LENGHT         10
 #define UPT_DATA_WIDTH          FONT_WIDTH * UPT_DATA_LENGHT
-#define UPT_DATA_X1             188
+#define UPT_DATA_X1             (layout->upt_data_x)
 #define UPT_DATA_X2             UPT_DATA_X1 + UPT_DATA_WIDTH
-#define UPT_DATA_Y1             166
+#define UPT_DATA_Y1             (layout->row_y[0])
 #define UPT_DATA_Y2             UPT_DATA_Y1 + FONT_HEIGHT
 
-#define FS1_LABEL_X1            140
-#define FS1_FIXED_X1            187
+#define FS1_LABEL_X1            (layout->right_label_x)
+#define FS1_FIXED_X1            (layout->fs_fixed_x)
 #define FS1_DATA_LENGHT         4
 #define FS1_DATA_WIDTH          FONT_WIDTH * FS1_DATA_LENGHT
-#define FS1_DATA_X1             254
+#define FS1_DATA_X1             (layout->fs_data_x)
 #define FS1_DATA_X2             FS1_DATA_X1 + FS1_DATA_WIDTH
-#define FS1_DATA_Y1             188
+#define FS1_DATA_Y1             (layout->row_y[1])
 #define FS1_DATA_Y2             FS1_DATA_Y1 + FONT_HEIGHT
 
-#define FS2_LABEL_X1            140
-#define FS2_FIXED_X1            187
+#define FS2_LABEL_X1            (layout->right_label_x)
+#define FS2_FIXED_X1            (layout->fs_fixed_x)
 #define FS2_DATA_LENGHT         4
 #define FS2_DATA_WIDTH          FONT_WIDTH * FS2_DATA_LENGHT
-#define FS2_DATA_X1             254
+#define FS2_DATA_X1             (layout->fs_data_x)
 #define FS2_DATA_X2             FS2_DATA_X1 + FS2_DATA_WIDTH
-#define FS2_DATA_Y1             210
+#define FS2_DATA_Y1             (layout->row_y[2])
 #define FS2_DATA_Y2             FS2_DATA_Y1 + FONT_HEIGHT
 
-#define SQUARE1_X               10
-#define SQUARE1_Y               11
-#define SQUARE1_W               300
-#define SQUARE1_H               46
+#define DETAIL_LINES            8
+#define DETAIL_LINE_LENGHT      (layout->detail_line_length)
+#define DETAIL_LINE_X           (layout->detail_line_x)
+#define DETAIL_LINE_Y           (layout->detail_line_y)
+#define DETAIL_LINE_STEP        (layout->detail_line_step)
+#define DETAIL_VALUE_LENGHT     (layout->detail_value_length)
+#define DETAIL_VALUE_X          (layout->detail_value_x)
+
+#define PAGE_OVERVIEW           0
+#define PAGE_NETWORK            1
+#define PAGE_DISKS              2
+#define PAGE_PROCESSES          3
+#define PAGE_THERMAL            4
+#define PAGE_PRESSURE           5
+#define PAGE_EVENTS             6
+#define PAGE_MEMORY             7
+#define PAGE_LIVE               8
+#define PAGE_SERVICES           9
+#define PAGE_CLUSTER            10
+#define PAGE_INTERRUPTS         11
+#define PAGE_LATENCY            12
+#define PAGE_QUANTILES          13
+#define PAGE_CLOCK              14
+#define PAGE_COUNT              15
+#define PAGE_REDRAW             0x80000000
+
+#define COLLECTOR_NET           0x0001
+#define COLLECTOR_CPU           0x0002
+#define COLLECTOR_RAM           0x0004
+#define COLLECTOR_TEMP          0x0008
+#define COLLECTOR_UPTIME        0x0010
+#define COLLECTOR_FS            0x0020
+#define COLLECTOR_PROC          0x0040
+#define COLLECTOR_FREQ          0x0080
+#define COLLECTOR_DISK          0x0100
+#define COLLECTOR_PSI           0x0200
+#define COLLECTOR_CGROUP        0x0400
+#define COLLECTOR_TCP           0x0800
+#define COLLECTOR_WIFI          0x1000
+#define COLLECTOR_IRQ           0x2000
+#define COLLECTOR_PROBE         0x4000
+#define COLLECTOR_CLOCK         0x8000
+#define COLLECTOR_SCHED         0x10000
+#define SCREEN_COLLECTORS       COLLECTOR_CLOCK
+
+#define STARTUP_RESET           0       /* Reset line held low while the rest of the startup goes on                        */
+#define STARTUP_WAKE            1       /* Reset released, waiting for the controller before the init sequence              */
+#define STARTUP_RUNNING         2
+#define LCD_RESET_TIME          120     /* Milliseconds of each reset phase                                                 */
+#define PANEL_OK                0
+#define PANEL_FAILED            1       /* Panel writes are dropped until the recovery starts                               */
+#define PANEL_RESET             2
+#define PANEL_WAKE              3
+#define PANEL_BACKOFF_MAX       60      /* Seconds between two recoveries of a panel still failing                          */
+#define SPI_ERROR_LIMIT         8       /* Consecutive failed SPI transfers before the panel is reset                       */
+#define SPI_READ_SPEED          4000000 /* Hz, the controller is read much slower than it is written                        */
+#define ST7789_RDDPM_READY      0x14    /* Sleep out and display on, both lost when the controller resets                   */
+#define IP_DISCOVERY_TIMEOUT    120     /* Seconds before a network device without address is reported as not ready         */
+#define BUTTON_DEBOUNCE_TIME    30      /* Milliseconds, shorter presses are contact bounce                                 */
+#define MAX_POLL_FDS            32
+#define PROC_TABLE_SIZE         1024
+#define DISKSTATS_BUFFER_SIZE   16384
+#define FS_IO_LENGHT            6
+#define THERMAL_SENSORS         8
+#define MAX_CPUS                8
+#define THROTTLE_UNDERVOLTAGE   0x0001  /* Firmware get_throttled flags, the same bits shifted by 16 are the flags since boot */
+#define THROTTLE_FREQ_CAPPED    0x0002
+#define THROTTLE_THROTTLED      0x0004
+#define THROTTLE_SOFT_LIMIT     0x0008
+#define MAX_ALERTS              16
+#define EVENTS_SIZE             32
+#define EVENT_TEXT_SIZE         40      /* Longest event text, an alert with its metric name, value and threshold               */
+#define METRIC_CPU              0
+#define METRIC_RAM              1
+#define METRIC_TEMP             2
+#define METRIC_FS1              3
+#define METRIC_FS2              4
+#define METRIC_FS1_UTIL         5
+#define METRIC_FS2_UTIL         6
+#define METRIC_FS1_AWAIT        7
+#define METRIC_FS2_AWAIT        8
+#define METRIC_NET1_RX          9
+#define METRIC_NET1_TX          10
+#define METRIC_NET2_RX          11
+#define METRIC_NET2_TX          12
+#define METRIC_PSI_CPU          13
+#define METRIC_PSI_MEMORY       14
+#define METRIC_PSI_IO           15
+#define METRIC_SWAP             16
+#define METRIC_SWAP_IO          17
+#define METRIC_TCP_RETRANS      18
+#define METRIC_TCP_LISTEN_DROPS 19
+#define METRIC_TCP_ESTABLISHED  20
+#define METRIC_TCP_TIME_WAIT    21
+#define METRIC_TCP_ORPHAN       22
+#define METRIC_UDP_ERRORS       23
+#define METRIC_NET1_SIGNAL      24
+#define METRIC_NET2_SIGNAL      25
+#define METRIC_CTXT             26
+#define METRIC_NET_RX_SOFTIRQ   27
+#define METRIC_RTT              28
+#define METRIC_PROBE_LOSS       29
+#define METRIC_CLOCK_ERROR      30
+#define METRIC_CLOCK_OFFSET     31
+#define METRIC_RUN_DELAY        32
+#define METRIC_SLICE_WAIT       33
+#define METRIC_DAEMON_WAIT      34
+#define SIGNAL_X                (layout->signal_x)
+#define RTT_X                   (layout->rtt_x)
+#define SIGNAL_WIDTH            16
+#define CLOCK_HISTORY           9
+#define SCHEDSTAT_BUFFER_SIZE   8192
+#define CLOCK_HISTORY_STEP      60      /* Seconds between the offsets kept for the clock page                              */
+#define CLOCK_STEP_LIMIT        2       /* Seconds the wall clock may move against the monotonic one before it is a step        */
+#define NL80211_BUFFER_SIZE     8192
+#define NL80211_TIMEOUT         100     /* Milliseconds to wait for the station info                                       */
+#define KEYED_FILE_KEYS         8
+#define KEYED_FILE_BUFFER_SIZE  8192
+#define TABLE_FILE_KEYS         8
+#define SNMP_TCP_CURR_ESTAB     0
+#define SNMP_TCP_OUT_SEGS       1
+#define SNMP_TCP_RETRANS_SEGS   2
+#define SNMP_UDP_IN_ERRORS      3
+#define SNMP_UDP_RCVBUF_ERRORS  4
+#define NETSTAT_LISTEN_OVERFLOWS 0
+#define NETSTAT_LISTEN_DROPS    1
+#define MEMINFO_TOTAL           0
+#define MEMINFO_AVAILABLE       1
+#define MEMINFO_CACHED          2
+#define MEMINFO_SWAP_TOTAL      3
+#define MEMINFO_SWAP_FREE       4
+#define MEMINFO_DIRTY           5
+#define MEMINFO_WRITEBACK       6
+#define VMSTAT_PSWPIN           0
+#define VMSTAT_PSWPOUT          1
+#define PROC_STAT_CTXT          0
+#define PROC_STAT_RUNNING       1
+#define PROC_STAT_BLOCKED       2
+#define MAX_IRQS                96      /* Rows of /proc/interrupts tracked, the rest are ignored                           */
+#define IRQ_ID_SIZE             8
+#define IRQ_NAME_SIZE           16
+#define IRQ_BUFFER_SIZE         16384
+#define IRQ_CORE_LINES          4
+#define PSI_CPU                 0
+#define PSI_MEMORY              1
+#define PSI_IO                  2
+#define PSI_RESOURCES           3
+#define PSI_ALERT_HOLD          10      /* Seconds a field stays highlighted after a stall event                            */
+#define TOP_PROCESSES           7
+#define MAX_CGROUPS             4
+#define CGROUP_CPU_STAT         0
+#define CGROUP_MEMORY_CURRENT   1
+#define CGROUP_MEMORY_MAX       2
+#define CGROUP_IO_STAT          3
+#define CGROUP_CPU_PRESSURE     4
+#define CGROUP_FILES            5
+#define LIVE_FIELDS             5
+#define LIVE_CPU                0
+#define LIVE_NET1_RX            1
+#define LIVE_NET1_TX            2
+#define LIVE_NET2_RX            3
+#define LIVE_NET2_TX            4
+#define LIVE_VALUE_LENGHT       10
+#define LIVE_MAX_RATE           50
+#define BUDGET_INTERVAL         60      /* Seconds between checks of the CPU time used by the process                      */
+#define BUDGET_LEVELS           3
+#define BUDGET_LIVE_RATE        2       /* Live page frames per second while over the CPU budget                           */
+#define RFB_MAX_CLIENTS         2
+#define RFB_DIRTY_RECTS         16
+#define RFB_INPUT_SIZE          512
+#define RFB_BUFFER_SIZE         (SCREEN_WIDTH * SCREEN_HEIGHT * 4 + RFB_DIRTY_RECTS * 16 + 16)
+#define RFB_STATE_VERSION       0
+#define RFB_STATE_SECURITY      1
+#define RFB_STATE_INIT          2
+#define RFB_STATE_NORMAL        3
+#define LOG_BUFFER_SIZE         8192    /* Bytes of each of the two log buffers, messages are dropped while both are full   */
+#define LOG_MESSAGE_SIZE        256
+#define LOG_RATE_ENTRIES        8
+#define LOG_RATE_WINDOW         10      /* Seconds an identical message is counted instead of written                       */
+#define LOG_JOURNAL_SOCKET      "/run/systemd/journal/socket"
+#define TRACE_BUFFER_SIZE       65536
+#define TRACE_MAGIC             "RMTRACE1"
+#define TRACE_READ              0       /* Bytes returned by a proc or sys read, a directory list or a system call        */
+#define TRACE_START             1       /* Collectors started                                                              */
+#define TRACE_TICK              2       /* Once per second update                                                          */
+#define TRACE_FRAME             3       /* Live page frame                                                                 */
+#define TRACE_PAGE              4       /* Page shown by the user button, the value is the page                            */
+#define TRACE_PSI               5       /* Pressure stall trigger, the value is the resource                               */
+#define PROC_LIST_SIZE          16384
+#define CLUSTER_PEERS           16
+#define CLUSTER_MAGIC           0x524d
+#define CLUSTER_VERSION         1
+#define CLUSTER_NAME_SIZE       16
+#define CLUSTER_NAME_LENGHT     5       /* Characters of the peer name column on the cluster page                          */
+#define CLUSTER_HEADER_SIZE     24      /* Magic, version, size, sequence and name, the part every snapshot version has    */
+#define CLUSTER_SNAPSHOT_SIZE   38      /* Bytes of a version 1 snapshot, later versions may only append fields            */
+#define CLUSTER_EXPIRY          3       /* Send intervals without a snapshot before a peer is dropped                      */
+#define CLUSTER_ALERT           90      /* Worst metric percent shown in the alert color                                   */
+#define CLUSTER_COLLECTORS      (COLLECTOR_NET | COLLECTOR_CPU | COLLECTOR_RAM | COLLECTOR_TEMP | COLLECTOR_FS | COLLECTOR_DISK)
+#define HISTOGRAM_BUCKETS       96      /* Four buckets per power of two, the last one holds the values from 2^24 up        */
+#define PROBE_TARGETS           4
+#define PROBE_NAME_SIZE         16
+#define PROBE_WINDOW            120     /* Probes counted before the histogram and the loss counts are halved              */
+#define PROBE_LOST              UINT32_MAX
+#define PROBE_RTT_LENGHT        4
+#define DAEMONS                 4
+#define DAEMON_NAME_SIZE        16
+#define DAEMON_BACKOFF_MAX      60      /* Seconds between two lookups of a daemon not running                             */
+#define DAEMON_SWAP_TIME        5       /* Seconds the hostname and the daemons are shown in turn on the overview          */
+#define SKETCH_SLOTS            900     /* Seconds of the 15 minutes window, the last 60 also give the 1 minute window     */
+#define SKETCH_BUCKETS          513
+#define SKETCH_EMPTY            0
+#define SKETCH_ZERO             256     /* Code of the values below 1/16, the negative values are coded below it           */
+#define SKETCH_WINDOWS          3
+#define SKETCH_MINUTE           0
+#define SKETCH_QUARTER          1
+#define SKETCH_AWAKE            2
+#define SKETCH_PAGE_TIME        5       /* Seconds each group of metrics stays on the quantiles page                       */
+#define SKETCH_COLLECTORS       (COLLECTOR_NET | COLLECTOR_CPU | COLLECTOR_RAM | COLLECTOR_TEMP | COLLECTOR_FS | COLLECTOR_DISK | COLLECTOR_PSI | COLLECTOR_TCP | COLLECTOR_WIFI | COLLECTOR_IRQ | COLLECTOR_PROBE | COLLECTOR_CLOCK | COLLECTOR_SCHED)
+
+struct net_stats {
+    long rx_bytes;
+    long rx_packets;
+    long rx_errs;
+    long rx_drop;
+    long tx_bytes;
+    long tx_packets;
+    long tx_errs;
+    long tx_drop;
+};
+
+struct wifi_info {
+    bool wireless;
+    bool station;
+    unsigned int ifindex;
+    double link;
+    double level;
+    double noise;
+    unsigned long retry;
+    int signal;
+    unsigned int bitrate;
+    uint32_t tx_retries;
+    uint32_t tx_failed;
+    uint32_t tx_retries_diff;
+    uint32_t tx_failed_diff;
+};
+
+struct disk_stats {
+    unsigned long reads;
+    unsigned long sectors_read;
+    unsigned long read_ticks;
+    unsigned long writes;
+    unsigned long sectors_written;
+    unsigned long write_ticks;
+    unsigned long io_ticks;
+};
+
+struct disk_info {
+    bool ready;
+    unsigned int major;
+    unsigned int minor;
+    struct disk_stats stats;
+    double read_rate;
+    double write_rate;
+    double iops;
+    double utilization;
+    double await;
+};
+
+struct thermal_sensor {
+    char name[24];
+    char path[64];
+    int fd;
+    long value;
+};
+
+struct cpu_freq {
+    char cur_path[64];
+    char max_path[64];
+    int cur_fd;
+    int max_fd;
+    long cur;
+    long max;
+    long hw_max;
+};
+
+struct keyed_file {
+    const char* path;
+    const char* keys[KEYED_FILE_KEYS];
+    unsigned int count;
+    int fd;
+    bool indexed;
+    int lines[KEYED_FILE_KEYS];
+    long long values[KEYED_FILE_KEYS];
+};
+
+struct table_file {
+    const char* path;
+    const char* keys[TABLE_FILE_KEYS];
+    unsigned int count;
+    int fd;
+    bool indexed;
+    int lines[TABLE_FILE_KEYS];
+    int columns[TABLE_FILE_KEYS];
+    long long values[TABLE_FILE_KEYS];
+};
+
+struct trace_record {
+    uint32_t time;
+    int32_t length;
+    uint8_t kind;
+    uint8_t path_length;
+    uint16_t value;
+};
+
+struct metric {
+    const char* name;
+    uint32_t collector;
+    double (*value)(void);
+};
+
+struct alert {
+    int metric;
+    double threshold;
+    double clear;
+    unsigned int duration;
+    bool active;
+    time_t since;
+};
+
+struct event {
+    time_t time;
+    bool raised;
+    char text[EVENT_TEXT_SIZE];
+};
+
+struct cgroup_info {
+    char path[128];
+    char name[8];
+    int fds[CGROUP_FILES];
+    bool ready;
+    unsigned long long usage_usec;
+    unsigned long long throttled_usec;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    long long memory_current;
+    long long memory_max;
+    double cpu_percent;
+    double throttled_percent;
+    double read_rate;
+    double write_rate;
+    double pressure;
+};
+
+struct live_field {
+    long long value;
+    long long total;
+    long long time;
+    char text[LIVE_VALUE_LENGHT + 1];
+};
+
+struct rect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+};
+
+struct panel_layout {
+    const char* name;
+    uint16_t width;
+    uint16_t height;
+    uint16_t offset_x[2];
+    uint16_t offset_y[2];
+    struct rect boxes[LAYOUT_BOXES];
+    uint16_t name_y;
+    uint16_t time_x;
+    uint16_t time_y;
+    uint16_t net_label_x;
+    uint16_t signal_x;
+    uint16_t net_rx_data_x;
+    uint16_t net_rx_label_x;
+    uint16_t net_tx_data_x;
+    uint16_t net_tx_label_x;
+    uint16_t net1_label_y;
+    uint16_t net1_data_y;
+    uint16_t net2_label_y;
+    uint16_t net2_data_y;
+    uint16_t rtt_x;
+    uint16_t left_label_x;
+    uint16_t left_data_x;
+    uint16_t temp_data_x;
+    uint16_t temp_fixed_x;
+    uint16_t flag_x;
+    uint16_t upt_label_x;
+    uint16_t upt_data_x;
+    uint16_t right_label_x;
+    uint16_t fs_fixed_x;
+    uint16_t fs_data_x;
+    uint16_t row_y[3];
+    uint16_t detail_line_x;
+    uint16_t detail_line_y;
+    uint16_t detail_line_step;
+    uint16_t detail_value_x;
+    uint8_t detail_line_length;
+    uint8_t detail_value_length;
+};
+
+struct rfb_client {
+    int fd;
+    int state;
+    int minor_version;
+    uint8_t input[RFB_INPUT_SIZE];
+    size_t input_size;
+    size_t skip;
+    size_t output_size;
+    size_t output_sent;
+    bool update_requested;
+    bool rre;
+    struct rect dirty[RFB_DIRTY_RECTS];
+    unsigned int dirty_count;
+    uint8_t bytes_per_pixel;
+    bool big_endian;
+    uint16_t max[3];
+    uint8_t shift[3];
+    uint8_t output[RFB_BUFFER_SIZE];
+};
+
+struct cluster_peer {
+    char name[CLUSTER_NAME_SIZE + 1];
+    uint32_t sequence;
+    time_t last_seen;
+    uint8_t cpu;
+    uint8_t ram;
+    uint8_t fs;
+    uint8_t utilization;
+    int16_t temp;
+    uint32_t rx;
+    uint32_t tx;
+    unsigned int severity;
+};
+
+struct histogram {
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint32_t total;
+};
+
+struct probe_target {
+    char name[PROBE_NAME_SIZE];
+    struct sockaddr_in address;         /* A port selects a TCP connect probe instead of an ICMP echo */
+    int fd;
+    bool pending;
+    uint16_t sequence;
+    long long sent_time;
+    uint32_t last_rtt;
+    uint32_t min_rtt;
+    uint32_t sent;
+    uint32_t lost;
+    struct histogram rtt;
+};
+
+struct daemon {
+    char name[DAEMON_NAME_SIZE];        /* Matched against the process names unless a pidfile is given */
+    char pidfile[128];
+    pid_t pid;
+    int fd;
+    bool up;
+    bool started;
+    unsigned int restarts;
+    unsigned int backoff;
+    long long retry_time;
+    int sched_fd;
+    unsigned long long run_delay;
+    unsigned long long timeslices;
+    double slice_wait;                  /* Microseconds waited for a core per timeslice */
+};
+
+struct sketch {
+    uint16_t slots[SKETCH_SLOTS];       /* One code per second, indexed by the monotonic time */
+    time_t last_time;
+    uint32_t awake[SKETCH_BUCKETS];
+    uint32_t awake_total;
+};
+
+struct log_rate {
+    uint32_t hash;
+    time_t since;
+    unsigned int count;
+    char level[8];
+    char text[LOG_MESSAGE_SIZE];
+};
 
-#define SQUARE2_X               10
-#define SQUARE2_Y               64
-#define SQUARE2_W               300
-#define SQUARE2_H               90
+struct process_info {
+    pid_t pid;
+    unsigned long ticks;
+    char name[16];
+};
 
-#define SQUARE3_X               10
-#define SQUARE3_Y               161
-#define SQUARE3_W               111
-#define SQUARE3_H               68
+struct collector {
+    uint32_t mask;
+    int (*collect)(void);
+    int (*warm)(void);
+    unsigned int* interval;
+    time_t last_run;
+    bool slow;
+};
 
-#define SQUARE4_X               128
-#define SQUARE4_Y               161
-#define SQUARE4_W               182
-#define SQUARE4_H               68
+struct page {
+    uint32_t collectors;
+    void (*compose)(uint16_t buffer[][SCREEN_WIDTH]);
+    int (*update)(uint32_t updated);
+    bool optional;
+};
 
 const char* chipname = "gpiochip0";
 struct gpiod_chip* gpio_chip;
@@ -383,10 +907,138 @@ struct gpiod_line* user_button_pin;
 struct gpiod_line* st7789_backlight_pin;
 struct gpiod_line* st7789_reset_pin;
 struct gpiod_line* st7789_data_pin;
-long rx_ifdev1_bytes = 0;
-long tx_ifdev1_bytes = 0;
-long rx_ifdev2_bytes = 0;
-long tx_ifdev2_bytes = 0;
+int net_dev_fd = -1;
+int wireless_fd = -1;
+int nl80211_fd = -1;
+int nl80211_family = 0;
+uint32_t nl80211_sequence = 0;
+struct wifi_info ifdev1_wifi;
+struct wifi_info ifdev2_wifi;
+int loadavg_fd = -1;
+int uptime_fd = -1;
+struct net_stats ifdev1_stats;
+struct net_stats ifdev2_stats;
+struct net_stats ifdev1_diff;
+struct net_stats ifdev2_diff;
+char ifdev1_address[30] = "Waiting...";
+char ifdev2_address[30] = "Waiting...";
+bool ifdev1_ready = false;
+bool ifdev2_ready = false;
+int ip_netlink_fd = -1;
+long long ip_discovery_deadline = 0;
+double cpu_load = 0;
+int ram_used = 0;
+struct keyed_file meminfo = { "/proc/meminfo", { "MemTotal:", "MemAvailable:", "Cached:", "SwapTotal:", "SwapFree:", "Dirty:", "Writeback:", }, 7, -1, false, };
+struct keyed_file vmstat = { "/proc/vmstat", { "pswpin ", "pswpout ", }, 2, -1, false, };
+struct keyed_file proc_stat = { "/proc/stat", { "ctxt ", "procs_running ", "procs_blocked ", }, 3, -1, false, };
+long long ctxt_count = 0;
+double ctxt_rate = 0;
+int interrupts_fd = -1;
+int softirqs_fd = -1;
+size_t interrupts_header = 0;
+unsigned int interrupts_cpus = 0;
+size_t softirqs_header = 0;
+unsigned int softirqs_cpus = 0;
+char irq_ids[MAX_IRQS][IRQ_ID_SIZE];
+char irq_names[MAX_IRQS][IRQ_NAME_SIZE];
+long long irq_counts[MAX_IRQS];
+double irq_rates[MAX_IRQS];
+unsigned int irqs_count = 0;
+long long irq_core_counts[MAX_CPUS];
+double irq_core_rates[MAX_CPUS];
+long long softirq_core_counts[MAX_CPUS];
+double softirq_core_rates[MAX_CPUS];
+long long net_rx_core_counts[MAX_CPUS];
+double net_rx_core_rates[MAX_CPUS];
+long long irq_sample_time = 0;
+int schedstat_fd = -1;
+unsigned int sched_cpus = 0;
+unsigned long long sched_run_delays[MAX_CPUS];
+unsigned long long sched_timeslices[MAX_CPUS];
+double sched_delay_rates[MAX_CPUS];
+double sched_slice_waits[MAX_CPUS];
+long long sched_sample_time = 0;
+long swap_in_pages = 0;
+long swap_out_pages = 0;
+struct table_file snmp = { "/proc/net/snmp", { "Tcp: CurrEstab", "Tcp: OutSegs", "Tcp: RetransSegs", "Udp: InErrors", "Udp: RcvbufErrors", }, 5, -1, false, };
+struct table_file netstat = { "/proc/net/netstat", { "TcpExt: ListenOverflows", "TcpExt: ListenDrops", }, 2, -1, false, };
+int sockstat_fd = -1;
+long long tcp_out_segs = 0;
+long long tcp_retrans_segs = 0;
+long long tcp_listen_overflows = 0;
+long long tcp_listen_drops = 0;
+long long udp_in_errors = 0;
+double tcp_retrans_rate = 0;
+double tcp_retrans_percent = 0;
+double tcp_listen_overflow_rate = 0;
+double tcp_listen_drop_rate = 0;
+double udp_error_rate = 0;
+long tcp_established = 0;
+long tcp_time_wait = 0;
+long tcp_orphan = 0;
+long long tcp_sample_time = 0;
+double swap_in_rate = 0;
+double swap_out_rate = 0;
+long long swap_sample_time = 0;
+long temp_value = 0;
+struct thermal_sensor thermal_sensors[THERMAL_SENSORS];
+unsigned int thermal_sensors_count = 0;
+bool thermal_sensors_ready = false;
+struct cpu_freq cpu_freqs[MAX_CPUS];
+unsigned int cpu_freqs_count = 0;
+bool cpu_freqs_ready = false;
+bool freq_capped = false;
+int throttled_fd = -1;
+int undervoltage_fd = -1;
+char undervoltage_path[64] = "";
+unsigned int throttled_flags = 0;
+bool throttled_flags_ready = false;
+time_t uptime_value = 0;
+struct statvfs fs1_stat;
+struct statvfs fs2_stat;
+struct disk_info fs1_disk;
+struct disk_info fs2_disk;
+long long disk_sample_time = 0;
+int diskstats_fd = -1;
+const char* psi_files[PSI_RESOURCES] = { "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io", };
+int psi_fds[PSI_RESOURCES] = { -1, -1, -1, };
+int psi_trigger_fds[PSI_RESOURCES] = { -1, -1, -1, };
+double psi_some[PSI_RESOURCES];
+double psi_full[PSI_RESOURCES];
+unsigned int psi_events[PSI_RESOURCES];
+time_t psi_alert_time[PSI_RESOURCES];
+const char* cgroup_files[CGROUP_FILES] = { "cpu.stat", "memory.current", "memory.max", "io.stat", "cpu.pressure", };
+struct cgroup_info cgroups[MAX_CGROUPS];
+unsigned int cgroups_count = 0;
+long long cgroup_sample_time = 0;
+struct alert alerts[MAX_ALERTS];
+unsigned int alerts_count = 0;
+uint32_t alert_collectors = 0;
+struct event events[EVENTS_SIZE];
+unsigned int events_count = 0;
+unsigned int events_version = 0;
+pid_t proc_pids[2][PROC_TABLE_SIZE];
+unsigned long proc_ticks[2][PROC_TABLE_SIZE];
+unsigned int proc_count[2] = { 0, 0, };
+unsigned int proc_table = 0;
+unsigned int processes_total = 0;
+unsigned int processes_running = 0;
+unsigned int processes_blocked = 0;
+struct process_info top_processes[TOP_PROCESSES];
+unsigned int top_processes_count = 0;
+long clock_ticks = 100;
+char log_buffers[2][LOG_BUFFER_SIZE];
+size_t log_length = 0;
+unsigned int log_active = 0;
+unsigned int log_dropped = 0;
+struct log_rate log_rates[LOG_RATE_ENTRIES];
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+pthread_t log_thread;
+bool log_running = false;
+int log_fd = -1;
+int log_journal_fd = -1;
+off_t log_size = 0;
 bool service_running = true;
 bool update_screen = true;
 bool check_sda = false;
@@ -394,15 +1046,170 @@ bool check_sdb = false;
 bool check_ifdev1 = true;
 bool check_ifdev2 = false;
 time_t last_time;
+int startup_state = STARTUP_RESET;
+long long startup_deadline = 0;
+long long start_time = 0;
+long long first_frame_time = 0;
+int data_pin_level = -1;
+long long next_tick_time = 0;
 int spidev_fd;
+long long spi_bytes = 0;
+unsigned int screen_frames = 0;
+unsigned int spi_errors = 0;
+unsigned int spi_consecutive_errors = 0;
+int panel_state = PANEL_OK;
+unsigned int panel_backoff = 1;
+long long panel_recovery_time = 0;
+long long panel_fault_time = 0;
+long long panel_recovery_duration = 0;
+unsigned int panel_faults = 0;
+unsigned int panel_recoveries = 0;
+unsigned int panel_recovery_failures = 0;
+unsigned int panel_status_faults = 0;
+time_t panel_check_time = 0;
+bool color_depth_switch = false;
+bool stats_dump_request = false;
+unsigned int current_page = PAGE_OVERVIEW;
+struct live_field live_fields[LIVE_FIELDS];
+long long live_values[LIVE_FIELDS];
+long long live_cpu_total = 0;
+int live_stat_fd = -1;
+int live_net_fd = -1;
+bool live_active = false;
+long long live_until = 0;
+long long next_frame_time = 0;
+unsigned int live_next_field = 0;
+unsigned int live_frames = 0;
+unsigned int live_dropped_frames = 0;
+unsigned int live_skipped_fields = 0;
+long long live_spi_time = 0;
+uint32_t active_collectors = 0;
+struct pollfd poll_fds[MAX_POLL_FDS];
+void (*poll_handlers[MAX_POLL_FDS])(int fd, short revents);
+unsigned int poll_fds_count = 0;
+/* One layout per panel geometry, all drawn in landscape. The buffers keep the size  */
+/* of the largest panel and only the top left part of them is sent to a smaller    */
+/* one, at the RAM window offset of the module for the configured rotation.         */
+const struct panel_layout panel_layouts[] = {
+    {
+        .name = "320x240", .width = 320, .height = 240, .offset_x = { 0, 0, }, .offset_y = { 0, 0, },
+        .boxes = { { 10, 11, 300, 46, }, { 10, 64, 300, 90, }, { 10, 161, 111, 68, }, { 128, 161, 182, 68, }, { 10, 64, 300, 165, }, },
+        .name_y = 16, .time_x = 58, .time_y = 38,
+        .net_label_x = 22, .signal_x = 88, .net_rx_data_x = 126, .net_rx_label_x = 170, .net_tx_data_x = 232, .net_tx_label_x = 276,
+        .net1_label_y = 69, .net1_data_y = 91, .net2_label_y = 113, .net2_data_y = 135, .rtt_x = 22,
+        .left_label_x = 22, .left_data_x = 65, .temp_data_x = 66, .temp_fixed_x = 99, .flag_x = 110,
+        .upt_label_x = 140, .upt_data_x = 188, .right_label_x = 140, .fs_fixed_x = 187, .fs_data_x = 254, .row_y = { 166, 188, 210, },
+        .detail_line_x = 22, .detail_line_y = 69, .detail_line_step = 20, .detail_value_x = 88, .detail_line_length = 26, .detail_value_length = 20,
+    },
+    {
+        .name = "240x240", .width = 240, .height = 240, .offset_x = { 0, 80, }, .offset_y = { 0, 0, },
+        .boxes = { { 5, 11, 230, 46, }, { 5, 64, 230, 90, }, { 5, 161, 106, 68, }, { 116, 161, 119, 68, }, { 5, 64, 230, 165, }, },
+        .name_y = 16, .time_x = 15, .time_y = 38,
+        .net_label_x = 12, .signal_x = 68, .net_rx_data_x = 88, .net_rx_label_x = 132, .net_tx_data_x = 162, .net_tx_label_x = 206,
+        .net1_label_y = 69, .net1_data_y = 91, .net2_label_y = 113, .net2_data_y = 135, .rtt_x = LAYOUT_HIDDEN,
+        .left_label_x = 10, .left_data_x = 54, .temp_data_x = 54, .temp_fixed_x = 87, .flag_x = 98,
+        .upt_label_x = LAYOUT_HIDDEN, .upt_data_x = 121, .right_label_x = 121, .fs_fixed_x = LAYOUT_HIDDEN, .fs_data_x = 186, .row_y = { 166, 188, 210, },
+        .detail_line_x = 12, .detail_line_y = 69, .detail_line_step = 20, .detail_value_x = 78, .detail_line_length = 20, .detail_value_length = 14,
+    },
+    {
+        .name = "135x240", .width = 240, .height = 135, .offset_x = { 40, 40, }, .offset_y = { 53, 52, },
+        .boxes = { { 5, 2, 230, 38, }, { 5, 44, 230, 37, }, { 5, 84, 106, 50, }, { 116, 84, 119, 50, }, { 5, 44, 230, 90, }, },
+        .name_y = 4, .time_x = 15, .time_y = 21,
+        .net_label_x = 12, .signal_x = 68, .net_rx_data_x = 88, .net_rx_label_x = 132, .net_tx_data_x = 162, .net_tx_label_x = 206,
+        .net1_label_y = 46, .net1_data_y = LAYOUT_HIDDEN, .net2_label_y = 63, .net2_data_y = LAYOUT_HIDDEN, .rtt_x = LAYOUT_HIDDEN,
+        .left_label_x = 10, .left_data_x = 54, .temp_data_x = 54, .temp_fixed_x = 87, .flag_x = 98,
+        .upt_label_x = LAYOUT_HIDDEN, .upt_data_x = 121, .right_label_x = 121, .fs_fixed_x = LAYOUT_HIDDEN, .fs_data_x = 186, .row_y = { 86, 102, 118, },
+        .detail_line_x = 12, .detail_line_y = 46, .detail_line_step = 17, .detail_value_x = 78, .detail_line_length = 20, .detail_value_length = 14,
+    },
+};
+const struct panel_layout* layout = &panel_layouts[0];
+uint16_t screen_buffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+struct rfb_client rfb_clients[RFB_MAX_CLIENTS];
+int rfb_tcp_fd = -1;
+int rfb_unix_fd = -1;
+uint16_t background_buffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+uint16_t page_background[SCREEN_HEIGHT][SCREEN_WIDTH];
+unsigned int page_background_page = PAGE_COUNT;
+unsigned int page_background_version = 0;
+unsigned int background_version = 1;
+bool panel_synced = false;
+int cluster_fd = -1;
+struct sockaddr_in cluster_address;
+struct cluster_peer cluster_peers[CLUSTER_PEERS];
+unsigned int cluster_peers_count = 0;
+unsigned int cluster_version = 0;
+uint32_t cluster_sequence = 0;
+time_t cluster_send_time = 0;
+struct probe_target probes[PROBE_TARGETS];
+unsigned int probes_count = 0;
+unsigned int probe_version = 0;
+bool probes_open = false;
+int clock_state = TIME_OK;
+int clock_status = 0;
+double clock_offset = 0;
+double clock_estimated_error = 0;
+double clock_maximum_error = 0;
+double clock_frequency = 0;
+double clock_history[CLOCK_HISTORY];
+unsigned int clock_history_count = 0;
+time_t clock_history_time = 0;
+time_t clock_history_base = 0;
+struct daemon daemons[DAEMONS];
+unsigned int daemons_count = 0;
+unsigned int daemon_version = 0;
+long long daemon_retry_time = 0;
+char host_name[30] = "";
 
 unsigned int update_fs_time = 300;
 unsigned int sleep_after = 3600;
+unsigned int long_press_time = 1000;
+unsigned int color_depth = 16;
+unsigned int panel_rotation = 180;
+int panel_offset_x = -1;
+int panel_offset_y = -1;
+unsigned int live_rate = 10;
+unsigned int live_frame_budget = 20;
+unsigned int live_timeout = 120;
+double cpu_budget = 0.2;
+unsigned int budget_level = 0;
+const unsigned int budget_slow_interval[BUDGET_LEVELS] = { 0, 5, 15, };
+double budget_usage = 0;
+long long budget_cpu_time = 0;
+long long budget_check_time = 0;
 unsigned int user_button_pin_id = 20;
 unsigned int st7789_backlight_pin_id = 18;
 unsigned int st7789_reset_pin_id = 27;
 unsigned int st7789_data_pin_id = 25;
+unsigned int log_max_size = 1024;
+unsigned int log_journal = 0;
+char trace_record_file[128] = "";
+char trace_replay_file[128] = "";
+unsigned int trace_replay_pace = 0;
+int trace_fd = -1;
+uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+size_t trace_length = 0;
+long long trace_start_time = 0;
+bool trace_replaying = false;
+long long trace_clock = 0;
+int64_t trace_wall_time = 0;
+const uint8_t* trace_data = NULL;
+size_t trace_size = 0;
+size_t trace_block_start = 0;
+size_t trace_block_end = 0;
+size_t trace_cursor = 0;
+bool panel_attached = true;
 char log_file[255] = "raspi-mon.log";
+char stats_file[255] = "raspi-mon.stats";
+unsigned int vnc_port = 0;
+char vnc_socket[108] = "";
+char cluster_group[16] = "";
+char cluster_name[CLUSTER_NAME_SIZE + 1] = "";
+unsigned int cluster_port = 5199;
+unsigned int cluster_interval = 5;
+unsigned int cluster_receive = 0;
+unsigned int probe_interval = 5;
+unsigned int panel_check_interval = 0;
+double clock_max_error = 100;
 char spi_device[255] = "/dev/spidev0.0";
 char ifdev1_id[255] = "eth0";
 char ifdev2_id[255] = "wlan0";
@@ -413,52 +1220,326 @@ uint16_t fixed_text_color_code = 0x1ca5;
 uint16_t label_text_color_code = 0x5fce;
 uint16_t window_color_code = 0x8e11;
 uint16_t background_color_code = 0x0d00;
+uint16_t alert_color_code = 0x00f8;
+char psi_triggers[PSI_RESOURCES][100] = { "some 300000 2000000", "some 300000 2000000", "some 300000 2000000", };
 
 void signals_handler(int sig) {
     if (sig == SIGINT || sig == SIGTERM)
         service_running = false;
+    if (sig == SIGUSR1)
+        color_depth_switch = true;
+    if (sig == SIGUSR2)
+        stats_dump_request = true;
 }
 
-void write_error(char* msg) {
+/* While a trace is replayed the clock follows the recorded times, so rates and    */
+/* intervals come out as they were computed on the recording system.               */
+long long monotonic_time_ms(void) {
+    struct timespec ts;
+
+    if (trace_replaying)
+        return trace_clock;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long monotonic_time_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+time_t wall_time(void) {
+    return trace_replaying ? (time_t)trace_wall_time : time(NULL);
+}
+
+/* Log messages are formatted into the active one of two buffers and written by a    */
+/* background thread, the whole batch with a single write every second, so a failing  */
+/* device costs one SD card write per second instead of one per message. The caller  */
+/* must hold the log mutex.                                                           */
+void log_append(const char* level, const char* text) {
     char time_string[20];
-    time_t current_time;
-    struct tm* local_time;
-    FILE* filePointer;
+    char* buffer = log_buffers[log_active];
+    time_t current_time = time(NULL);
+    struct tm local_time;
+    int length;
 
-    if (0 < (current_time = time(NULL))) {
-        local_time = localtime(&current_time);
-        strftime(time_string, sizeof(time_string), "%F %T", local_time);
-        if ((filePointer = fopen(log_file, "a")) != NULL) {
-            fprintf(filePointer, "%s ERROR %s - %s\n", time_string, msg, errno != 0 ? strerror(errno) : "");
-            fclose(filePointer);
-        }
+    localtime_r(&current_time, &local_time);
+    strftime(time_string, sizeof(time_string), "%F %T", &local_time);
+    length = snprintf(buffer + log_length, LOG_BUFFER_SIZE - log_length, "%s %s %s\n", time_string, level, text);
+    if (length < 0 || LOG_BUFFER_SIZE - log_length <= (size_t)length) {
+        log_dropped++;
+        return;
     }
+    log_length += length;
+    if (LOG_BUFFER_SIZE / 2 < log_length)
+        pthread_cond_signal(&log_cond);
 }
 
-void* user_button_read_thread(void* vargp) {
-    int readed_status;
-    struct timespec ts;
+uint32_t log_hash(const char* level, const char* text) {
+    uint32_t hash = 2166136261u;
 
-    while (service_running) {
-        readed_status = gpiod_line_get_value(user_button_pin);
-        if (readed_status == 0) {
-            timespec_get(&ts, TIME_UTC);
-            last_time = ts.tv_sec;
-            update_screen = true;
-            gpiod_line_set_value(st7789_backlight_pin, 1);
+    while (*level)
+        hash = (hash ^ (uint8_t)*level++) * 16777619u;
+    while (*text)
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    return hash;
+}
+
+void log_release(struct log_rate* rate, time_t current_time) {
+    char text[LOG_MESSAGE_SIZE + 32];
+
+    if (1 < rate->count) {
+        snprintf(text, sizeof(text), "%s (x%u in %lds)", rate->text, rate->count - 1, (long)(current_time - rate->since));
+        log_append(rate->level, text);
+    }
+    rate->count = 0;
+}
+
+/* Identical messages inside the rate window are only counted, the first one is      */
+/* written right away and the repetitions are summarized when the window is over.    */
+void log_message(const char* level, const char* text) {
+    time_t current_time = monotonic_time_ms() / 1000;
+    uint32_t hash = log_hash(level, text);
+    struct log_rate* rate = &log_rates[0];
+
+    pthread_mutex_lock(&log_mutex);
+    for (unsigned int i = 0; i < LOG_RATE_ENTRIES; i++) {
+        if (log_rates[i].count && log_rates[i].hash == hash && strncmp(log_rates[i].text, text, LOG_MESSAGE_SIZE - 1) == 0 && strcmp(log_rates[i].level, level) == 0) {
+            log_rates[i].count++;
+            pthread_mutex_unlock(&log_mutex);
+            return;
         }
-        usleep(100000);
+        if (rate->count && (!log_rates[i].count || log_rates[i].since < rate->since))
+            rate = &log_rates[i];
+    }
+    log_release(rate, current_time);
+    rate->hash = hash;
+    rate->since = current_time;
+    rate->count = 1;
+    snprintf(rate->level, sizeof(rate->level), "%s", level);
+    snprintf(rate->text, sizeof(rate->text), "%s", text);
+    log_append(level, text);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+int log_open_file(void) {
+    struct stat file_stat;
+
+    if ((log_fd = open(log_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+        return -1;
+    log_size = fstat(log_fd, &file_stat) == 0 ? file_stat.st_size : 0;
+    return 0;
+}
+
+void log_rotate(void) {
+    char rotated_file[sizeof(log_file) + 2];
+
+    snprintf(rotated_file, sizeof(rotated_file), "%s.1", log_file);
+    close(log_fd);
+    rename(log_file, rotated_file);
+    log_open_file();
+}
+
+/* Every line becomes one journal entry of the native protocol, the priority is taken */
+/* from the level after the 19 characters timestamp, which is left to the journal.    */
+void log_write_journal(char* buffer, size_t length) {
+    char entry[LOG_MESSAGE_SIZE + 128];
+    char* end = buffer + length;
+    char* line;
+    char* level;
+    char* text;
+    int priority;
+    int size;
+
+    for (line = buffer; line < end; line = text + 1) {
+        level = line + 20;
+        if (end <= level || (text = memchr(level, ' ', end - level)) == NULL)
+            break;
+        priority = strncmp(level, "ERROR", 5) == 0 ? 3 : strncmp(level, "ALERT", 5) == 0 ? 4 : 6;
+        line = ++text;
+        if ((text = memchr(line, '\n', end - line)) == NULL)
+            text = end;
+        size = snprintf(entry, sizeof(entry), "PRIORITY=%d\nSYSLOG_IDENTIFIER=raspi-mon\nMESSAGE=%.*s\n", priority, (int)(text - line), line);
+        if (0 < size)
+            send(log_journal_fd, entry, (size_t)size < sizeof(entry) ? (size_t)size : sizeof(entry) - 1, MSG_NOSIGNAL);
+    }
+}
+
+void log_write(char* buffer, size_t length) {
+    ssize_t written;
+
+    if (0 <= log_journal_fd) {
+        log_write_journal(buffer, length);
+        return;
+    }
+    if (0 <= log_fd && log_max_size && (off_t)log_max_size * 1024 < log_size + (off_t)length)
+        log_rotate();
+    if (log_fd < 0 && log_open_file() < 0)
+        return;
+    if (0 < (written = write(log_fd, buffer, length)))
+        log_size += written;
+}
+
+/* Summarizes the expired repetitions and writes the active buffer while producers   */
+/* fill the other one. Called with the log mutex held, it is released while writing. */
+void log_flush(bool final) {
+    time_t current_time = monotonic_time_ms() / 1000;
+    char dropped[48];
+    unsigned int buffer;
+    size_t length;
+
+    for (unsigned int i = 0; i < LOG_RATE_ENTRIES; i++)
+        if (log_rates[i].count && (final || LOG_RATE_WINDOW <= current_time - log_rates[i].since))
+            log_release(&log_rates[i], current_time);
+    buffer = log_active;
+    length = log_length;
+    log_active ^= 1;
+    log_length = 0;
+    if (log_dropped) {
+        snprintf(dropped, sizeof(dropped), "%u log messages dropped", log_dropped);
+        log_dropped = 0;
+        log_append("ERROR", dropped);
     }
+    if (length == 0)
+        return;
+    pthread_mutex_unlock(&log_mutex);
+    log_write(log_buffers[buffer], length);
+    pthread_mutex_lock(&log_mutex);
+}
 
+void* log_flush_thread(void* arg) {
+    struct timespec deadline;
+
+    pthread_mutex_lock(&log_mutex);
+    while (log_running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec++;
+        pthread_cond_timedwait(&log_cond, &log_mutex, &deadline);
+        log_flush(false);
+    }
+    log_flush(true);
+    log_flush(true);
+    pthread_mutex_unlock(&log_mutex);
     return NULL;
 }
 
+/* Under systemd the journal native socket is used when it is enabled in the config, */
+/* signals are blocked in the flush thread so they always reach the main loop.        */
+void log_open(void) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX, .sun_path = LOG_JOURNAL_SOCKET, };
+    sigset_t all_signals;
+    sigset_t old_signals;
+
+    if (log_journal && getenv("INVOCATION_ID") != NULL && 0 <= (log_journal_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0))) {
+        if (connect(log_journal_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            close(log_journal_fd);
+            log_journal_fd = -1;
+        }
+    }
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    log_running = true;
+    if (pthread_create(&log_thread, NULL, log_flush_thread, NULL) != 0)
+        log_running = false;
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+}
+
+void log_close(void) {
+    pthread_mutex_lock(&log_mutex);
+    if (log_running) {
+        log_running = false;
+        pthread_cond_signal(&log_cond);
+        pthread_mutex_unlock(&log_mutex);
+        pthread_join(log_thread, NULL);
+    }
+    else {
+        log_flush(true);
+        log_flush(true);
+        pthread_mutex_unlock(&log_mutex);
+    }
+    if (0 <= log_fd)
+        close(log_fd);
+    if (0 <= log_journal_fd)
+        close(log_journal_fd);
+}
+
+void write_error(char* msg) {
+    char text[LOG_MESSAGE_SIZE];
+
+    snprintf(text, sizeof(text), "%s - %s", msg, errno != 0 ? strerror(errno) : "");
+    log_message("ERROR", text);
+}
+
+void write_log(char* level, char* msg) {
+    log_message(level, msg);
+}
+
+int poll_register(int fd, short events, void (*handler)(int fd, short revents)) {
+    unsigned int i = 0;
+
+    while (i < poll_fds_count && 0 <= poll_fds[i].fd)
+        i++;
+    if (MAX_POLL_FDS <= i) {
+        write_error("Too many file descriptors in the poll set");
+        return -1;
+    }
+    poll_fds[i].fd = fd;
+    poll_fds[i].events = events;
+    poll_fds[i].revents = 0;
+    poll_handlers[i] = handler;
+    if (i == poll_fds_count)
+        poll_fds_count++;
+    return 0;
+}
+
+/* Handlers unregister descriptors while the poll results are dispatched, an entry */
+/* is only marked with a negative fd, which poll ignores, and removed afterwards.  */
+void poll_unregister(int fd) {
+    for (unsigned int i = 0; i < poll_fds_count; i++) {
+        if (poll_fds[i].fd != fd)
+            continue;
+        poll_fds[i].fd = -1;
+        poll_fds[i].revents = 0;
+        return;
+    }
+}
+
+void poll_dispatch(void) {
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < poll_fds_count; i++)
+        if (0 <= poll_fds[i].fd && poll_fds[i].revents)
+            poll_handlers[i](poll_fds[i].fd, poll_fds[i].revents);
+    for (unsigned int i = 0; i < poll_fds_count; i++) {
+        if (poll_fds[i].fd < 0)
+            continue;
+        poll_fds[count] = poll_fds[i];
+        poll_handlers[count++] = poll_handlers[i];
+    }
+    poll_fds_count = count;
+}
+
+void poll_set_events(int fd, short events) {
+    for (unsigned int i = 0; i < poll_fds_count; i++)
+        if (poll_fds[i].fd == fd)
+            poll_fds[i].events = events;
+}
+
+/* The reset line is requested first and held low, the reset delay then runs while */
+/* the other pins, the SPI device and the collectors are set up.                   */
 int gpio_open(void) {
     if ((gpio_chip = gpiod_chip_open_by_name(chipname)) == NULL) {
         write_error("Failed to open gpiochip0");
         return -1;
     }
-    if ((user_button_pin = gpiod_chip_get_line(gpio_chip, user_button_pin_id)) == NULL || (gpiod_line_request_input(user_button_pin, "monitor")) < 0) {
+    if ((st7789_reset_pin = gpiod_chip_get_line(gpio_chip, st7789_reset_pin_id)) == NULL || (gpiod_line_request_output(st7789_reset_pin, "monitor", 0)) < 0) {
+        write_error("Failed to request reset pin");
+        return -1;
+    }
+    startup_deadline = monotonic_time_ms() + LCD_RESET_TIME;
+    if ((user_button_pin = gpiod_chip_get_line(gpio_chip, user_button_pin_id)) == NULL || (gpiod_line_request_both_edges_events(user_button_pin, "monitor")) < 0) {
         write_error("Failed to request user button pin");
         return -1;
     }
@@ -466,14 +1547,11 @@ int gpio_open(void) {
         write_error("Failed to request backlight pin");
         return -1;
     }
-    if ((st7789_reset_pin = gpiod_chip_get_line(gpio_chip, st7789_reset_pin_id)) == NULL || (gpiod_line_request_output(st7789_reset_pin, "monitor", 1)) < 0) {
-        write_error("Failed to request reset pin");
-        return -1;
-    }
     if ((st7789_data_pin = gpiod_chip_get_line(gpio_chip, st7789_data_pin_id)) == NULL || (gpiod_line_request_output(st7789_data_pin, "monitor", 1)) < 0) {
         write_error("Failed to request data pin");
         return -1;
     }
+    data_pin_level = 1;
     return 0;
 }
 
@@ -485,6 +1563,44 @@ void gpio_close(void) {
     gpiod_chip_close(gpio_chip);
 }
 
+void add_event(bool raised, char* text) {
+    struct event* event = &events[events_count % EVENTS_SIZE];
+
+    event->time = wall_time();
+    event->raised = raised;
+    snprintf(event->text, sizeof(event->text), "%s", text);
+    events_count++;
+    events_version++;
+    write_log(raised ? "ALERT" : "INFO", text);
+}
+
+/* A panel with repeated SPI failures is marked as failed, then reset and restored */
+/* from the screen buffer after a delay doubled on each failed recovery. The screen */
+/* buffer is kept up to date meanwhile, the writes to the panel are dropped.        */
+void panel_fault(char* reason) {
+    long long current_time = monotonic_time_ms();
+
+    if (panel_state != PANEL_OK)
+        return;
+    if (panel_backoff == 1) {
+        panel_faults++;
+        panel_fault_time = current_time;
+    }
+    panel_state = PANEL_FAILED;
+    panel_recovery_time = current_time + panel_backoff * 1000LL;
+    add_event(true, reason);
+    panel_backoff = panel_backoff * 2 < PANEL_BACKOFF_MAX ? panel_backoff * 2 : PANEL_BACKOFF_MAX;
+}
+
+int spi_failed(char* message) {
+    spi_errors++;
+    if (SPI_ERROR_LIMIT <= ++spi_consecutive_errors)
+        panel_fault("SPI writes failing");
+    else
+        write_error(message);
+    return -1;
+}
+
 int spi_transfer(const uint8_t* data, const uint32_t data_size) {
     struct spi_ioc_transfer transfer = {
         .tx_buf = (unsigned long)data,
@@ -495,49 +1611,136 @@ int spi_transfer(const uint8_t* data, const uint32_t data_size) {
         .bits_per_word = 8,
     };
 
-    if (ioctl(spidev_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
-        write_error("Failed to perform SPI transfer");
+    /* Only the bytes that reach the panel are counted, or that would without one, */
+    /* so a trace replayed without the panel reports the same traffic.              */
+    if (!panel_attached) {
+        spi_bytes += data_size;
+        return 0;
+    }
+    if (panel_state != PANEL_OK)
+        return -1;
+    if (ioctl(spidev_fd, SPI_IOC_MESSAGE(1), &transfer) < 0)
+        return spi_failed("Failed to perform SPI transfer");
+    spi_bytes += data_size;
+    spi_consecutive_errors = 0;
+    return 0;
+}
+
+/* The data/command line is only toggled when its level changes. */
+int spi_set_data_pin(int level) {
+    if (data_pin_level == level || !panel_attached)
+        return 0;
+    if (panel_state != PANEL_OK)
         return -1;
+    if (gpiod_line_set_value(st7789_data_pin, level) < 0) {
+        data_pin_level = -1;
+        return spi_failed(level ? "Failed to set data pin" : "Failed to reset data pin");
     }
+    data_pin_level = level;
     return 0;
 }
 
-int spi_write_register(const uint8_t instruction, const uint8_t* data, const uint32_t data_size) {
-    if (gpiod_line_set_value(st7789_data_pin, 0) < 0) {
-        write_error("Failed to reset data pin");
+int spi_write_data(const uint8_t* data, const uint32_t data_size) {
+    if (spi_set_data_pin(1) < 0)
         return -1;
+    return spi_transfer(data, data_size);
+}
+
+/* Colors are kept as the RGB565 bytes sent to the panel, in 12 bit mode they are   */
+/* quantized to 4-4-4 and each pair of pixels is packed in three bytes. Transfers   */
+/* are kept on a pair boundary, an odd last pixel is sent in two bytes and the      */
+/* padding nibble is ignored by the controller.                                     */
+uint16_t rgb444(uint16_t color) {
+    color = color >> 8 | color << 8;
+    return (color >> 12) << 8 | (color >> 7 & 0x0f) << 4 | (color >> 1 & 0x0f);
+}
+
+int spi_write_pixels(const uint16_t* pixels, uint32_t count) {
+    static uint8_t packed[SPI_PIXEL_PAIRS * 3];
+    uint16_t first, second;
+    uint32_t size;
+    int result = 0;
+
+    if (color_depth != 12) {
+        for (uint32_t index = 0; index < count * 2; index += SPI_CHUNK_SIZE)
+            result += spi_write_data((const uint8_t*)pixels + index, count * 2 < index + SPI_CHUNK_SIZE ? count * 2 - index : SPI_CHUNK_SIZE);
+        return result;
     }
+    while (count) {
+        for (size = 0; size < sizeof(packed) && 1 < count; size += 3, pixels += 2, count -= 2) {
+            first = rgb444(pixels[0]);
+            second = rgb444(pixels[1]);
+            packed[size] = first >> 4;
+            packed[size + 1] = (first & 0x0f) << 4 | second >> 8;
+            packed[size + 2] = second & 0xff;
+        }
+        if (size < sizeof(packed) && count == 1) {
+            first = rgb444(*pixels);
+            packed[size++] = first >> 4;
+            packed[size++] = (first & 0x0f) << 4;
+            count = 0;
+        }
+        result += spi_write_data(packed, size);
+    }
+    return result;
+}
+
+int spi_write_register(const uint8_t instruction, const uint8_t* data, const uint32_t data_size) {
+    if (spi_set_data_pin(0) < 0)
+        return -1;
     if (spi_transfer(&instruction, 1) < 0)
         return -1;
-    if (gpiod_line_set_value(st7789_data_pin, 1) < 0) {
-        write_error("Failed to set data pin");
+    if (data != NULL && data_size != 0 && spi_write_data(data, data_size) < 0)
         return -1;
-    }
-    if (data != NULL && data_size != 0 && spi_transfer(data, data_size) < 0)
+    return 0;
+}
+
+/* The command is sent and the reply read in a single message, so the chip select  */
+/* stays low in between. Nothing is read back on the modules without MISO wired.   */
+int spi_read_register(uint8_t instruction, uint8_t* data, uint32_t data_size) {
+    struct spi_ioc_transfer transfers[2] = {
+        { .tx_buf = (unsigned long)&instruction, .len = 1, .speed_hz = SPI_READ_SPEED, .bits_per_word = 8, },
+        { .rx_buf = (unsigned long)data, .len = data_size, .speed_hz = SPI_READ_SPEED, .bits_per_word = 8, },
+    };
+
+    if (!panel_attached || spi_set_data_pin(0) < 0)
         return -1;
+    if (ioctl(spidev_fd, SPI_IOC_MESSAGE(2), transfers) < 0)
+        return spi_failed("Failed to read a panel register");
     return 0;
 }
 
+/* The power mode is read back when enabled, a controller that lost its power or   */
+/* saw a glitch on its reset line comes back asleep with the display off.           */
+bool panel_status_ready(void) {
+    uint8_t power_mode = 0;
+
+    return spi_read_register(ST7789_RDDPM, &power_mode, 1) == 0 && (power_mode & ST7789_RDDPM_READY) == ST7789_RDDPM_READY;
+}
+
+/* Checked once after the init sequence, a panel that does not answer then has no   */
+/* read line and the periodic check is turned off.                                  */
+void start_panel_check(void) {
+    if (!panel_check_interval || !panel_attached || panel_status_ready())
+        return;
+    write_log("INFO", "Panel status can not be read, the periodic check is disabled");
+    panel_check_interval = 0;
+}
+
+void check_panel_status(time_t current_time) {
+    if (!panel_check_interval || panel_state != PANEL_OK || current_time - panel_check_time < panel_check_interval)
+        return;
+    panel_check_time = current_time;
+    if (!panel_status_ready()) {
+        panel_status_faults++;
+        panel_fault("Panel reset detected");
+    }
+}
+
 int lcd_screen_open(void) {
-    uint8_t st7789_colmod[] = { 0x05, };
-    uint8_t st7789_porctrl[] = { 0x0C, 0x0C, 0x00, 0x33, 0x33, };
-    uint8_t st7789_gctrl[] = { 0x35, };
-    uint8_t st7789_vcoms[] = { 0x19, };
-    uint8_t st7789_lcmctrl[] = { 0x2C, };
-    uint8_t st7789_vdvvrhen[] = { 0x01, 0xFF, };
-    uint8_t st7789_vrhs[] = { 0x12, };
-    uint8_t st7789_vdvs[] = { 0x20, };
-    uint8_t st7789_frctrl2[] = { 0x0F, };
-    uint8_t st7789_pwctrl1[] = { 0xA4, 0xA1, };
-    uint8_t st7789_pvgamctrl[] = { 0xD0, 0x04, 0x0D, 0x11, 0x13, 0x2B, 0x3F, 0x54, 0x4C, 0x18, 0x0D, 0x0B, 0x1F, 0x23, };
-    uint8_t st7789_nvgamctrl[] = { 0xD0, 0x04, 0x0C, 0x11, 0x13, 0x2C, 0x3F, 0x44, 0x51, 0x2F, 0x1F, 0x1F, 0x20, 0x23, };
-    uint8_t st7789_invon[] = { 0x0E, };
-    uint8_t st7789_dispon[] = { 0x00, };
-    uint8_t st7789_madctl[] = { ST7789_LANDSCAPE_ROT180, };
     unsigned wr_max_speed = 32000000;
     char wr_mode = SPI_MODE_0;
     char bits_per_word = 8;
-    int result = 0;
 
     if ((spidev_fd = open(spi_device, O_RDWR)) < 0) {
         write_error("Failed to open spi device");
@@ -559,38 +1762,44 @@ int lcd_screen_open(void) {
         return -1;
     }
 
-    if (ioctl(spidev_fd, SPI_IOC_WR_MAX_SPEED_HZ, &wr_max_speed) < 0) {
-        write_error("Failed to set masx speed for spi device");
-        return -1;
-    }
+    return 0;
+}
 
-    if (gpiod_line_set_value(st7789_reset_pin, 0) < 0) {
-        write_error("Failed to reset the screen");
-        return -1;
-    }
-    usleep(120000);
-    if (gpiod_line_set_value(st7789_reset_pin, 1) < 0) {
-        write_error("Failed to reset the screen");
-        return -1;
-    }
-    usleep(120000);
-
-    result += spi_write_register(ST7789_SLPOUT, NULL, 0);
-    result += spi_write_register(ST7789_COLMOD, st7789_colmod, sizeof(st7789_colmod));
-    result += spi_write_register(ST7789_PORCTRL, st7789_porctrl, sizeof(st7789_porctrl));
-    result += spi_write_register(ST7789_GCTRL, st7789_gctrl, sizeof(st7789_gctrl));
-    result += spi_write_register(ST7789_VCOMS, st7789_vcoms, sizeof(st7789_vcoms));
-    result += spi_write_register(ST7789_LCMCTRL, st7789_lcmctrl, sizeof(st7789_lcmctrl));
-    result += spi_write_register(ST7789_VDVVRHEN, st7789_vdvvrhen, sizeof(st7789_vdvvrhen));
-    result += spi_write_register(ST7789_VRHS, st7789_vrhs, sizeof(st7789_vrhs));
-    result += spi_write_register(ST7789_VDVS, st7789_vdvs, sizeof(st7789_vdvs));
-    result += spi_write_register(ST7789_FRCTRL2, st7789_frctrl2, sizeof(st7789_frctrl2));
-    result += spi_write_register(ST7789_PWCTRL1, st7789_pwctrl1, sizeof(st7789_pwctrl1));
-    result += spi_write_register(ST7789_PVGAMCTRL, st7789_pvgamctrl, sizeof(st7789_pvgamctrl));
-    result += spi_write_register(ST7789_NVGAMCTRL, st7789_nvgamctrl, sizeof(st7789_nvgamctrl));
-    result += spi_write_register(ST7789_INVON, st7789_invon, sizeof(st7789_invon));
-    result += spi_write_register(ST7789_DISPON, st7789_dispon, sizeof(st7789_dispon));
-    result += spi_write_register(ST7789_MADCTL, st7789_madctl, sizeof(st7789_madctl));
+/* Init sequence, each command is followed by the number of parameters and the      */
+/* parameters themselves.                                                           */
+static const uint8_t st7789_init_sequence[] = {
+    ST7789_SLPOUT, 0,
+    ST7789_COLMOD, 1, 0x05,
+    ST7789_PORCTRL, 5, 0x0C, 0x0C, 0x00, 0x33, 0x33,
+    ST7789_GCTRL, 1, 0x35,
+    ST7789_VCOMS, 1, 0x19,
+    ST7789_LCMCTRL, 1, 0x2C,
+    ST7789_VDVVRHEN, 2, 0x01, 0xFF,
+    ST7789_VRHS, 1, 0x12,
+    ST7789_VDVS, 1, 0x20,
+    ST7789_FRCTRL2, 1, 0x0F,
+    ST7789_PWCTRL1, 2, 0xA4, 0xA1,
+    ST7789_PVGAMCTRL, 14, 0xD0, 0x04, 0x0D, 0x11, 0x13, 0x2B, 0x3F, 0x54, 0x4C, 0x18, 0x0D, 0x0B, 0x1F, 0x23,
+    ST7789_NVGAMCTRL, 14, 0xD0, 0x04, 0x0C, 0x11, 0x13, 0x2C, 0x3F, 0x44, 0x51, 0x2F, 0x1F, 0x1F, 0x20, 0x23,
+    ST7789_INVON, 1, 0x0E,
+    ST7789_DISPON, 1, 0x00,
+};
+
+int lcd_set_color_depth(void) {
+    uint8_t colmod = color_depth == 12 ? ST7789_COLMOD_12BIT : ST7789_COLMOD_16BIT;
+
+    return spi_write_register(ST7789_COLMOD, &colmod, 1);
+}
+
+int lcd_screen_init(void) {
+    uint8_t madctl = panel_rotation ? ST7789_LANDSCAPE_ROT180 : ST7789_LANDSCAPE;
+    int result = 0;
+
+    for (size_t i = 0; i < sizeof(st7789_init_sequence); i += 2 + st7789_init_sequence[i + 1])
+        result += spi_write_register(st7789_init_sequence[i], &st7789_init_sequence[i + 2], st7789_init_sequence[i + 1]);
+    result += spi_write_register(ST7789_MADCTL, &madctl, 1);
+    if (color_depth == 12)
+        result += lcd_set_color_depth();
 
     return result;
 }
@@ -599,83 +1808,611 @@ void lcd_screen_close(void) {
     close(spidev_fd);
 }
 
-int write_text_to_display(uint16_t buffer[], uint16_t data_size, char* text, uint8_t text_lenght, uint16_t text_color, uint16_t window_color, uint8_t* caset, uint8_t* raset) {
-    uint16_t char_row;
-    int result = 0;
+/* A minimal RFB 3.3/3.7/3.8 server mirrors the panel for viewers on localhost or a */
+/* unix socket. Every rectangle sent to the panel is copied into the screen buffer  */
+/* and marked dirty for each viewer, and a viewer only gets the dirty rectangles    */
+/* once it asks for an update and its previous one was fully written, so several    */
+/* ticks are merged for slow viewers and writing never blocks the main loop.        */
+void rfb_put16(uint8_t* out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value & 0xff;
+}
 
-    for (uint8_t i = 0; i < text_lenght; i++) {
-        for (uint16_t j = 0; j < FONT_HEIGHT; j++) {
-            char_row = font[text[i] - 31][j];
-            for (uint16_t k = 0; k < FONT_WIDTH && ((i * FONT_WIDTH) + k) < data_size; k++)
-                buffer[(j * text_lenght * FONT_WIDTH) + ((i * FONT_WIDTH) + k)] = (char_row << k) & 0x8000 ? text_color : window_color;
-        }
-    }
+void rfb_put32(uint8_t* out, uint32_t value) {
+    rfb_put16(out, value >> 16);
+    rfb_put16(out + 2, value & 0xffff);
+}
 
-    result += spi_write_register(ST7789_CASET, caset, 4);
-    result += spi_write_register(ST7789_RASET, raset, 4);
-    result += spi_write_register(ST7789_RAMWR, NULL, 0);
-    for (uint16_t index = 0; index < (data_size * 2); index += 4096)
-        result += spi_transfer(((uint8_t*)(buffer)) + index, (data_size * 2) < (index + 4096) ? (data_size * 2) - index : 4096);
-    return result;
+uint16_t rfb_get16(uint8_t* in) {
+    return in[0] << 8 | in[1];
 }
 
-int display_time_info(uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * TIME_DATA_WIDTH];
-    static uint8_t caset[] = { TIME_DATA_X1 >> 8, TIME_DATA_X1 & 0xff, TIME_DATA_X2 >> 8, (TIME_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { TIME_DATA_Y1 >> 8, TIME_DATA_Y1 & 0xff, TIME_DATA_Y2 >> 8, (TIME_DATA_Y2 - 1) & 0xff, };
-    char time_string[20];
-    time_t current_time;
-    struct tm* local_time;
-    int result = 0;
+uint32_t rfb_get32(uint8_t* in) {
+    return (uint32_t)rfb_get16(in) << 16 | rfb_get16(in + 2);
+}
 
-    if (0 < (current_time = time(NULL))) {
-        local_time = localtime(&current_time);
-        strftime(time_string, sizeof(time_string), "%F %T", local_time);
-        result + write_text_to_display(buffer, FONT_HEIGHT * TIME_DATA_WIDTH, time_string, TIME_DATA_LENGHT, text_color, window_color, caset, raset);
+void rfb_client_close(struct rfb_client* client) {
+    poll_unregister(client->fd);
+    close(client->fd);
+    client->fd = -1;
+}
+
+void rfb_write(struct rfb_client* client) {
+    ssize_t size;
+
+    if (client->output_sent < client->output_size) {
+        size = send(client->fd, client->output + client->output_sent, client->output_size - client->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            rfb_client_close(client);
+            return;
+        }
+        if (0 < size)
+            client->output_sent += size;
     }
+    if (client->output_sent < client->output_size)
+        poll_set_events(client->fd, POLLIN | POLLOUT);
+    else {
+        client->output_size = 0;
+        client->output_sent = 0;
+        poll_set_events(client->fd, POLLIN);
+    }
+}
 
-    return result;
+void rfb_queue(struct rfb_client* client, const void* data, size_t size) {
+    if (client->output_size + size <= RFB_BUFFER_SIZE) {
+        memcpy(client->output + client->output_size, data, size);
+        client->output_size += size;
+    }
 }
 
-int display_ifdev1_rx_info(long rx_bytes_diff, uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
-    static uint8_t caset[] = { IFDEV1_RX_DATA_X1 >> 8, IFDEV1_RX_DATA_X1 & 0xff, IFDEV1_RX_DATA_X2 >> 8, (IFDEV1_RX_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { IFDEV1_RX_DATA_Y1 >> 8, IFDEV1_RX_DATA_Y1 & 0xff, IFDEV1_RX_DATA_Y2 >> 8, (IFDEV1_RX_DATA_Y2 - 1) & 0xff, };
-    char net_data_string[10];
-    char units = 'B';
-    int result = 0;
+void rfb_add_dirty(struct rfb_client* client, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    struct rect* dirty;
+    uint16_t x2 = x + w;
+    uint16_t y2 = y + h;
 
-    if (999999999 < rx_bytes_diff) {
-        rx_bytes_diff /= 1024 * 1024 * 1024;
-        units = 'M';
+    for (unsigned int i = 0; i < client->dirty_count; i++) {
+        dirty = &client->dirty[i];
+        if (dirty->x <= x && dirty->y <= y && x2 <= dirty->x + dirty->w && y2 <= dirty->y + dirty->h)
+            return;
     }
-    else if (999999 < rx_bytes_diff) {
-        rx_bytes_diff /= 1024 * 1024;
-        units = 'M';
+    if (client->dirty_count < RFB_DIRTY_RECTS) {
+        client->dirty[client->dirty_count++] = (struct rect){ x, y, w, h, };
+        return;
     }
-    else if (999 < rx_bytes_diff) {
-        rx_bytes_diff /= 1024;
-        units = 'K';
+    for (unsigned int i = 0; i < client->dirty_count; i++) {
+        dirty = &client->dirty[i];
+        x = dirty->x < x ? dirty->x : x;
+        y = dirty->y < y ? dirty->y : y;
+        x2 = x2 < dirty->x + dirty->w ? dirty->x + dirty->w : x2;
+        y2 = y2 < dirty->y + dirty->h ? dirty->y + dirty->h : y2;
     }
+    client->dirty[0] = (struct rect){ x, y, x2 - x, y2 - y, };
+    client->dirty_count = 1;
+}
 
-    sprintf(net_data_string, "%3ld%c", rx_bytes_diff, units);
-    result + write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+void rfb_mark_dirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++)
+        if (0 <= rfb_clients[i].fd && rfb_clients[i].state == RFB_STATE_NORMAL)
+            rfb_add_dirty(&rfb_clients[i], x, y, w, h);
+}
 
-    return result;
+/* The panel pixels are RGB565 stored big endian, they are converted to the pixel    */
+/* format requested by the viewer.                                                   */
+uint8_t* rfb_put_pixel(struct rfb_client* client, uint8_t* out, uint16_t pixel) {
+    uint8_t* bytes = (uint8_t*)&pixel;
+    uint16_t rgb = bytes[0] << 8 | bytes[1];
+    uint32_t value;
+
+    value = ((uint32_t)(rgb >> 11) * client->max[0] / 31) << client->shift[0] |
+        ((uint32_t)((rgb >> 5) & 0x3f) * client->max[1] / 63) << client->shift[1] |
+        ((uint32_t)(rgb & 0x1f) * client->max[2] / 31) << client->shift[2];
+    for (uint8_t i = 0; i < client->bytes_per_pixel; i++)
+        *out++ = client->big_endian ? value >> (8 * (client->bytes_per_pixel - 1 - i)) : value >> (8 * i);
+    return out;
 }
 
-int display_ifdev1_tx_info(long tx_bytes_diff, uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
-    static uint8_t caset[] = { IFDEV1_TX_DATA_X1 >> 8, IFDEV1_TX_DATA_X1 & 0xff, IFDEV1_TX_DATA_X2 >> 8, (IFDEV1_TX_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { IFDEV1_TX_DATA_Y1 >> 8, IFDEV1_TX_DATA_Y1 & 0xff, IFDEV1_TX_DATA_Y2 >> 8, (IFDEV1_TX_DATA_Y2 - 1) & 0xff, };
-    char net_data_string[10];
-    char units = 'B';
-    int result = 0;
+/* RRE is used when the rectangle is mostly background, like the text fields, each  */
+/* run of pixels of the same color in a row is one subrectangle.                     */
+uint8_t* rfb_encode_rect(struct rfb_client* client, uint8_t* out, struct rect* rect) {
+    uint16_t background = screen_buffer[rect->y][rect->x];
+    size_t raw_size = (size_t)rect->w * rect->h * client->bytes_per_pixel;
+    uint32_t subrects = 0;
+    uint16_t* row;
+    uint16_t i, j, k;
 
-    if (999999999 < tx_bytes_diff) {
-        tx_bytes_diff /= 1024 * 1024 * 1024;
-        units = 'M';
-    }
+    rfb_put16(out, rect->x);
+    rfb_put16(out + 2, rect->y);
+    rfb_put16(out + 4, rect->w);
+    rfb_put16(out + 6, rect->h);
+    if (client->rre) {
+        for (j = 0; j < rect->h; j++) {
+            row = &screen_buffer[rect->y + j][rect->x];
+            for (i = 0; i < rect->w; i = k) {
+                for (k = i + 1; k < rect->w && row[k] == row[i]; k++);
+                if (row[i] != background)
+                    subrects++;
+            }
+        }
+    }
+    if (client->rre && 4 + client->bytes_per_pixel + subrects * (client->bytes_per_pixel + 8) < raw_size) {
+        rfb_put32(out + 8, 2);
+        rfb_put32(out + 12, subrects);
+        out = rfb_put_pixel(client, out + 16, background);
+        for (j = 0; j < rect->h; j++) {
+            row = &screen_buffer[rect->y + j][rect->x];
+            for (i = 0; i < rect->w; i = k) {
+                for (k = i + 1; k < rect->w && row[k] == row[i]; k++);
+                if (row[i] == background)
+                    continue;
+                out = rfb_put_pixel(client, out, row[i]);
+                rfb_put16(out, i);
+                rfb_put16(out + 2, j);
+                rfb_put16(out + 4, k - i);
+                rfb_put16(out + 6, 1);
+                out += 8;
+            }
+        }
+        return out;
+    }
+    rfb_put32(out + 8, 0);
+    out += 12;
+    for (j = 0; j < rect->h; j++)
+        for (i = 0; i < rect->w; i++)
+            out = rfb_put_pixel(client, out, screen_buffer[rect->y + j][rect->x + i]);
+    return out;
+}
+
+void rfb_send_update(struct rfb_client* client) {
+    size_t size = 4;
+    uint8_t* out;
+
+    if (client->state != RFB_STATE_NORMAL || !client->update_requested || client->dirty_count == 0 || client->output_size)
+        return;
+    for (unsigned int i = 0; i < client->dirty_count; i++)
+        size += 12 + (size_t)client->dirty[i].w * client->dirty[i].h * client->bytes_per_pixel;
+    if (RFB_BUFFER_SIZE < size) {
+        client->dirty[0] = (struct rect){ 0, 0, PANEL_WIDTH, PANEL_HEIGHT, };
+        client->dirty_count = 1;
+    }
+    out = client->output;
+    out[0] = 0;
+    out[1] = 0;
+    rfb_put16(out + 2, client->dirty_count);
+    out += 4;
+    for (unsigned int i = 0; i < client->dirty_count; i++)
+        out = rfb_encode_rect(client, out, &client->dirty[i]);
+    client->output_size = out - client->output;
+    client->dirty_count = 0;
+    client->update_requested = false;
+    rfb_write(client);
+}
+
+void rfb_send_updates(void) {
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++)
+        if (0 <= rfb_clients[i].fd)
+            rfb_send_update(&rfb_clients[i]);
+}
+
+void rfb_server_init(struct rfb_client* client) {
+    uint8_t message[24 + 64] = { 0, 0, 0, 0, 16, 16, 1, 1, 0, 31, 0, 63, 0, 31, 11, 5, 0, };
+    char name[64] = "raspi-mon";
+    size_t length;
+
+    rfb_put16(message, PANEL_WIDTH);
+    rfb_put16(message + 2, PANEL_HEIGHT);
+    gethostname(name, sizeof(name) - 1);
+    length = strlen(name);
+    rfb_put32(message + 20, length);
+    memcpy(message + 24, name, length);
+    rfb_queue(client, message, 24 + length);
+    client->bytes_per_pixel = 2;
+    client->big_endian = true;
+    client->max[0] = 31;
+    client->max[1] = 63;
+    client->max[2] = 31;
+    client->shift[0] = 11;
+    client->shift[1] = 5;
+    client->shift[2] = 0;
+    client->state = RFB_STATE_NORMAL;
+    rfb_add_dirty(client, 0, 0, PANEL_WIDTH, PANEL_HEIGHT);
+}
+
+/* Returns the bytes of the first message in the input, 0 when it is incomplete and */
+/* -1 when the client must be dropped.                                              */
+int rfb_parse_message(struct rfb_client* client) {
+    uint8_t* in = client->input;
+    size_t size = client->input_size;
+    char version[13];
+    uint8_t security[4] = { 0, 0, 0, 1, };
+    uint16_t count;
+    uint16_t x, y, w, h;
+
+    switch (client->state) {
+    case RFB_STATE_VERSION:
+        if (size < 12)
+            return 0;
+        memcpy(version, in, 12);
+        version[12] = 0;
+        if (sscanf(version, "RFB 003.%3d", &client->minor_version) != 1)
+            return -1;
+        if (client->minor_version < 7) {
+            rfb_queue(client, security, 4);
+            client->state = RFB_STATE_INIT;
+        }
+        else {
+            rfb_queue(client, "\x01\x01", 2);
+            client->state = RFB_STATE_SECURITY;
+        }
+        return 12;
+    case RFB_STATE_SECURITY:
+        if (in[0] != 1)
+            return -1;
+        if (8 <= client->minor_version)
+            rfb_queue(client, "\0\0\0\0", 4);
+        client->state = RFB_STATE_INIT;
+        return 1;
+    case RFB_STATE_INIT:
+        rfb_server_init(client);
+        return 1;
+    }
+    switch (in[0]) {
+    case 0:
+        if (size < 20)
+            return 0;
+        if (!in[7] || (in[4] != 8 && in[4] != 16 && in[4] != 32))
+            return -1;
+        client->bytes_per_pixel = in[4] / 8;
+        client->big_endian = in[6];
+        client->max[0] = rfb_get16(in + 8);
+        client->max[1] = rfb_get16(in + 10);
+        client->max[2] = rfb_get16(in + 12);
+        client->shift[0] = in[14];
+        client->shift[1] = in[15];
+        client->shift[2] = in[16];
+        client->dirty_count = 0;
+        rfb_add_dirty(client, 0, 0, PANEL_WIDTH, PANEL_HEIGHT);
+        return 20;
+    case 2:
+        if (size < 4)
+            return 0;
+        count = rfb_get16(in + 2);
+        if (RFB_INPUT_SIZE < 4 + (size_t)count * 4) {
+            client->rre = false;
+            client->skip = 4 + (size_t)count * 4 - size;
+            return size;
+        }
+        if (size < 4 + (size_t)count * 4)
+            return 0;
+        client->rre = false;
+        for (uint16_t i = 0; i < count; i++)
+            if (in[4 + i * 4] == 0 && in[5 + i * 4] == 0 && in[6 + i * 4] == 0 && in[7 + i * 4] == 2)
+                client->rre = true;
+        return 4 + count * 4;
+    case 3:
+        if (size < 10)
+            return 0;
+        x = rfb_get16(in + 2);
+        y = rfb_get16(in + 4);
+        w = rfb_get16(in + 6);
+        h = rfb_get16(in + 8);
+        if (!in[1] && x < PANEL_WIDTH && y < PANEL_HEIGHT)
+            rfb_add_dirty(client, x, y, PANEL_WIDTH - x < w ? PANEL_WIDTH - x : w, PANEL_HEIGHT - y < h ? PANEL_HEIGHT - y : h);
+        client->update_requested = true;
+        return 10;
+    case 4:
+        return size < 8 ? 0 : 8;
+    case 5:
+        return size < 6 ? 0 : 6;
+    case 6:
+        if (size < 8)
+            return 0;
+        client->skip = ((uint32_t)rfb_get16(in + 4) << 16) | rfb_get16(in + 6);
+        return 8;
+    }
+    return -1;
+}
+
+void rfb_client_event(int fd, short revents) {
+    struct rfb_client* client = NULL;
+    ssize_t size;
+    int used;
+
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++)
+        if (rfb_clients[i].fd == fd)
+            client = &rfb_clients[i];
+    if (client == NULL)
+        return;
+    if (revents & POLLOUT) {
+        rfb_write(client);
+        if (client->fd < 0)
+            return;
+    }
+    if (!(revents & (POLLIN | POLLERR | POLLHUP)))
+        return;
+    size = recv(fd, client->input + client->input_size, RFB_INPUT_SIZE - client->input_size, MSG_DONTWAIT);
+    if (size <= 0) {
+        if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            rfb_client_close(client);
+        return;
+    }
+    client->input_size += size;
+    while (client->input_size) {
+        if (client->skip) {
+            used = client->skip < client->input_size ? client->skip : client->input_size;
+            client->skip -= used;
+        }
+        else if ((used = rfb_parse_message(client)) < 0) {
+            rfb_client_close(client);
+            return;
+        }
+        else if (used == 0)
+            break;
+        client->input_size -= used;
+        memmove(client->input, client->input + used, client->input_size);
+    }
+    rfb_write(client);
+    if (0 <= client->fd)
+        rfb_send_update(client);
+}
+
+void rfb_accept_event(int fd, short revents) {
+    int client_fd;
+
+    if ((client_fd = accept(fd, NULL, NULL)) < 0)
+        return;
+    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+    fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++) {
+        if (0 <= rfb_clients[i].fd)
+            continue;
+        if (poll_register(client_fd, POLLIN, rfb_client_event) < 0)
+            break;
+        memset(&rfb_clients[i], 0, offsetof(struct rfb_client, output));
+        rfb_clients[i].fd = client_fd;
+        rfb_queue(&rfb_clients[i], "RFB 003.008\n", 12);
+        rfb_write(&rfb_clients[i]);
+        return;
+    }
+    close(client_fd);
+}
+
+int rfb_listen(int fd, struct sockaddr* address, socklen_t address_size) {
+    if (bind(fd, address, address_size) < 0 || listen(fd, RFB_MAX_CLIENTS) < 0 || poll_register(fd, POLLIN, rfb_accept_event) < 0) {
+        write_error("Failed to open the VNC server socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void rfb_open(void) {
+    struct sockaddr_in tcp_address = { .sin_family = AF_INET, .sin_port = htons(vnc_port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK), };
+    struct sockaddr_un unix_address = { .sun_family = AF_UNIX, };
+    int reuse = 1;
+    int fd;
+
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++)
+        rfb_clients[i].fd = -1;
+    if (vnc_port && 0 <= (fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        rfb_tcp_fd = rfb_listen(fd, (struct sockaddr*)&tcp_address, sizeof(tcp_address));
+    }
+    if (vnc_socket[0] && 0 <= (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))) {
+        snprintf(unix_address.sun_path, sizeof(unix_address.sun_path), "%s", vnc_socket);
+        unlink(vnc_socket);
+        rfb_unix_fd = rfb_listen(fd, (struct sockaddr*)&unix_address, sizeof(unix_address));
+    }
+}
+
+void rfb_stop(void) {
+    for (unsigned int i = 0; i < RFB_MAX_CLIENTS; i++)
+        if (0 <= rfb_clients[i].fd)
+            rfb_client_close(&rfb_clients[i]);
+    if (0 <= rfb_tcp_fd)
+        close(rfb_tcp_fd);
+    if (0 <= rfb_unix_fd) {
+        close(rfb_unix_fd);
+        unlink(vnc_socket);
+    }
+}
+
+/* Keeps the screen buffer equal to the panel contents. Returns false when the       */
+/* rectangle is unchanged, so it is neither sent to the panel nor to the viewers,    */
+/* otherwise only the columns and rows that changed are marked dirty.                */
+bool screen_copy_rect(uint16_t buffer[], uint16_t data_size, uint8_t* caset, uint8_t* raset) {
+    uint16_t x1 = caset[0] << 8 | caset[1];
+    uint16_t x2 = caset[2] << 8 | caset[3];
+    uint16_t y1 = raset[0] << 8 | raset[1];
+    uint16_t y2 = raset[2] << 8 | raset[3];
+    uint16_t width = x2 - x1 + 1;
+    uint16_t height = y2 - y1 + 1;
+    uint16_t left = width, right = 0, top = height, bottom = 0;
+    uint16_t* source;
+    uint16_t* target;
+
+    if (PANEL_WIDTH <= x1 || PANEL_HEIGHT <= y1)
+        return false;
+    if (x2 < x1 || y2 < y1 || data_size < width * height)
+        return true;
+    /* A field crossing the panel edge is clipped, only its visible part is kept. */
+    x2 = x2 < PANEL_WIDTH ? x2 : PANEL_WIDTH - 1;
+    y2 = y2 < PANEL_HEIGHT ? y2 : PANEL_HEIGHT - 1;
+    for (uint16_t row = 0; row <= y2 - y1; row++) {
+        source = buffer + (row * width);
+        target = &screen_buffer[y1 + row][x1];
+        for (uint16_t column = 0; column <= x2 - x1; column++) {
+            if (source[column] == target[column])
+                continue;
+            target[column] = source[column];
+            left = column < left ? column : left;
+            right = right < column ? column : right;
+            top = row < top ? row : top;
+            bottom = row;
+        }
+    }
+    if (width <= left)
+        return false;
+    rfb_mark_dirty(x1 + left, y1 + top, right - left + 1, bottom - top + 1);
+    return true;
+}
+
+/* The controller RAM is 240x320 and a smaller glass sits somewhere inside it, so   */
+/* the address window is moved by the offset of the module for the rotation used.   */
+int lcd_write_window(uint8_t* caset, uint8_t* raset) {
+    uint16_t offset_x = panel_offset_x < 0 ? layout->offset_x[panel_rotation != 0] : panel_offset_x;
+    uint16_t offset_y = panel_offset_y < 0 ? layout->offset_y[panel_rotation != 0] : panel_offset_y;
+    uint8_t window[4];
+    int result = 0;
+
+    rfb_put16(window, rfb_get16(caset) + offset_x);
+    rfb_put16(window + 2, rfb_get16(caset + 2) + offset_x);
+    result += spi_write_register(ST7789_CASET, window, 4);
+    rfb_put16(window, rfb_get16(raset) + offset_y);
+    rfb_put16(window + 2, rfb_get16(raset + 2) + offset_y);
+    result += spi_write_register(ST7789_RASET, window, 4);
+    result += spi_write_register(ST7789_RAMWR, NULL, 0);
+
+    return result;
+}
+
+/* The visible part of a field crossing the panel edge is packed in rows of its      */
+/* visible width and sent to the clipped window, in a single write so the 12-bit   */
+/* pixel pairs stay aligned.                                                        */
+int write_rect_to_display(uint16_t buffer[], uint16_t data_size, uint8_t* caset, uint8_t* raset) {
+    static uint16_t clipped[SCREEN_WIDTH * FONT_HEIGHT];
+    uint16_t x1 = caset[0] << 8 | caset[1];
+    uint16_t x2 = caset[2] << 8 | caset[3];
+    uint16_t y1 = raset[0] << 8 | raset[1];
+    uint16_t y2 = raset[2] << 8 | raset[3];
+    uint16_t width = x2 - x1 + 1;
+    uint16_t visible_width;
+    uint16_t visible_height;
+    uint8_t visible_caset[4];
+    uint8_t visible_raset[4];
+    int result = 0;
+
+    if (!screen_copy_rect(buffer, data_size, caset, raset))
+        return result;
+    if (x2 < x1 || y2 < y1 || (x2 < PANEL_WIDTH && y2 < PANEL_HEIGHT)) {
+        result += lcd_write_window(caset, raset);
+        result += spi_write_pixels(buffer, data_size);
+        return result;
+    }
+    x2 = x2 < PANEL_WIDTH ? x2 : PANEL_WIDTH - 1;
+    y2 = y2 < PANEL_HEIGHT ? y2 : PANEL_HEIGHT - 1;
+    visible_width = x2 - x1 + 1;
+    visible_height = y2 - y1 + 1;
+    if (sizeof(clipped) / sizeof(clipped[0]) < (size_t)visible_width * visible_height)
+        return -1;
+    for (uint16_t row = 0; row < visible_height; row++)
+        memcpy(clipped + row * visible_width, buffer + row * width, visible_width * sizeof(uint16_t));
+    memcpy(visible_caset, caset, 2);
+    visible_caset[2] = x2 >> 8;
+    visible_caset[3] = x2 & 0xff;
+    memcpy(visible_raset, raset, 2);
+    visible_raset[2] = y2 >> 8;
+    visible_raset[3] = y2 & 0xff;
+    result += lcd_write_window(visible_caset, visible_raset);
+    result += spi_write_pixels(clipped, visible_width * visible_height);
+    return result;
+}
+
+int write_text_to_display(uint16_t buffer[], uint16_t data_size, char* text, uint8_t text_lenght, uint16_t text_color, uint16_t window_color, uint8_t* caset, uint8_t* raset) {
+    uint16_t char_row;
+    int result = 0;
+
+    for (uint8_t i = 0; i < text_lenght; i++) {
+        for (uint16_t j = 0; j < FONT_HEIGHT; j++) {
+            char_row = font[text[i] - 31][j];
+            for (uint16_t k = 0; k < FONT_WIDTH && ((i * FONT_WIDTH) + k) < data_size; k++)
+                buffer[(j * text_lenght * FONT_WIDTH) + ((i * FONT_WIDTH) + k)] = (char_row << k) & 0x8000 ? text_color : window_color;
+        }
+    }
+
+    return result + write_rect_to_display(buffer, data_size, caset, raset);
+}
+
+int write_text_field(uint16_t x, uint16_t y, char* text, uint8_t text_lenght, uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * FONT_WIDTH * MAX_CHARS_IN_LINE];
+    char line[MAX_CHARS_IN_LINE + 1];
+    uint16_t x2, y2;
+    uint8_t i;
+
+    if (MAX_CHARS_IN_LINE < text_lenght)
+        text_lenght = MAX_CHARS_IN_LINE;
+    for (i = 0; i < text_lenght && text[i]; i++)
+        line[i] = ((unsigned char)text[i] < 31 || 126 < (unsigned char)text[i]) ? ' ' : text[i];
+    for (; i < text_lenght; i++)
+        line[i] = ' ';
+
+    x2 = x + (FONT_WIDTH * text_lenght) - 1;
+    y2 = y + FONT_HEIGHT - 1;
+    uint8_t caset[] = { x >> 8, x & 0xff, x2 >> 8, x2 & 0xff, };
+    uint8_t raset[] = { y >> 8, y & 0xff, y2 >> 8, y2 & 0xff, };
+    return write_text_to_display(buffer, FONT_HEIGHT * FONT_WIDTH * text_lenght, line, text_lenght, text_color, window_color, caset, raset);
+}
+
+bool clock_alert(void) {
+    return clock_state == TIME_ERROR || (clock_status & STA_UNSYNC) || clock_max_error < clock_estimated_error;
+}
+
+int display_time_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * TIME_DATA_WIDTH];
+    uint8_t caset[] = { TIME_DATA_X1 >> 8, TIME_DATA_X1 & 0xff, TIME_DATA_X2 >> 8, (TIME_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { TIME_DATA_Y1 >> 8, TIME_DATA_Y1 & 0xff, TIME_DATA_Y2 >> 8, (TIME_DATA_Y2 - 1) & 0xff, };
+    char time_string[20];
+    time_t current_time;
+    struct tm local_time;
+    int result = 0;
+
+    if (0 < (current_time = wall_time())) {
+        localtime_r(&current_time, &local_time);
+        strftime(time_string, sizeof(time_string), "%F %T", &local_time);
+        result += write_text_to_display(buffer, FONT_HEIGHT * TIME_DATA_WIDTH, time_string, TIME_DATA_LENGHT, clock_alert() ? alert_color_code : text_color, window_color, caset, raset);
+    }
+
+    return result;
+}
+
+int display_ifdev1_rx_info(long rx_bytes_diff, uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
+    uint8_t caset[] = { IFDEV1_RX_DATA_X1 >> 8, IFDEV1_RX_DATA_X1 & 0xff, IFDEV1_RX_DATA_X2 >> 8, (IFDEV1_RX_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { IFDEV1_RX_DATA_Y1 >> 8, IFDEV1_RX_DATA_Y1 & 0xff, IFDEV1_RX_DATA_Y2 >> 8, (IFDEV1_RX_DATA_Y2 - 1) & 0xff, };
+    char net_data_string[10];
+    char units = 'B';
+    int result = 0;
+
+    if (999999999 < rx_bytes_diff) {
+        rx_bytes_diff /= 1024 * 1024 * 1024;
+        units = 'M';
+    }
+    else if (999999 < rx_bytes_diff) {
+        rx_bytes_diff /= 1024 * 1024;
+        units = 'M';
+    }
+    else if (999 < rx_bytes_diff) {
+        rx_bytes_diff /= 1024;
+        units = 'K';
+    }
+
+    sprintf(net_data_string, "%3ld%c", rx_bytes_diff, units);
+    result += write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+int display_ifdev1_tx_info(long tx_bytes_diff, uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
+    uint8_t caset[] = { IFDEV1_TX_DATA_X1 >> 8, IFDEV1_TX_DATA_X1 & 0xff, IFDEV1_TX_DATA_X2 >> 8, (IFDEV1_TX_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { IFDEV1_TX_DATA_Y1 >> 8, IFDEV1_TX_DATA_Y1 & 0xff, IFDEV1_TX_DATA_Y2 >> 8, (IFDEV1_TX_DATA_Y2 - 1) & 0xff, };
+    char net_data_string[10];
+    char units = 'B';
+    int result = 0;
+
+    if (999999999 < tx_bytes_diff) {
+        tx_bytes_diff /= 1024 * 1024 * 1024;
+        units = 'M';
+    }
     else if (999999 < tx_bytes_diff) {
         tx_bytes_diff /= 1024 * 1024;
         units = 'M';
@@ -686,15 +2423,15 @@ int display_ifdev1_tx_info(long tx_bytes_diff, uint16_t text_color, uint16_t win
     }
 
     sprintf(net_data_string, "%3ld%c", tx_bytes_diff, units);
-    result + write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+    result += write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
 
     return result;
 }
 
 int display_ifdev2_rx_info(long rx_bytes_diff, uint16_t text_color, uint16_t window_color) {
     static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
-    static uint8_t caset[] = { IFDEV2_RX_DATA_X1 >> 8, IFDEV2_RX_DATA_X1 & 0xff, IFDEV2_RX_DATA_X2 >> 8, (IFDEV2_RX_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { IFDEV2_RX_DATA_Y1 >> 8, IFDEV2_RX_DATA_Y1 & 0xff, IFDEV2_RX_DATA_Y2 >> 8, (IFDEV2_RX_DATA_Y2 - 1) & 0xff, };
+    uint8_t caset[] = { IFDEV2_RX_DATA_X1 >> 8, IFDEV2_RX_DATA_X1 & 0xff, IFDEV2_RX_DATA_X2 >> 8, (IFDEV2_RX_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { IFDEV2_RX_DATA_Y1 >> 8, IFDEV2_RX_DATA_Y1 & 0xff, IFDEV2_RX_DATA_Y2 >> 8, (IFDEV2_RX_DATA_Y2 - 1) & 0xff, };
     char net_data_string[10];
     char units = 'B';
     int result = 0;
@@ -713,15 +2450,15 @@ int display_ifdev2_rx_info(long rx_bytes_diff, uint16_t text_color, uint16_t win
     }
 
     sprintf(net_data_string, "%3ld%c", rx_bytes_diff, units);
-    result + write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+    result += write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
 
     return result;
 }
 
 int display_ifdev2_tx_info(long tx_bytes_diff, uint16_t text_color, uint16_t window_color) {
     static uint16_t buffer[FONT_HEIGHT * NET_DATA_WIDTH];
-    static uint8_t caset[] = { IFDEV2_TX_DATA_X1 >> 8, IFDEV2_TX_DATA_X1 & 0xff, IFDEV2_TX_DATA_X2 >> 8, (IFDEV2_TX_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { IFDEV2_TX_DATA_Y1 >> 8, IFDEV2_TX_DATA_Y1 & 0xff, IFDEV2_TX_DATA_Y2 >> 8, (IFDEV2_TX_DATA_Y2 - 1) & 0xff, };
+    uint8_t caset[] = { IFDEV2_TX_DATA_X1 >> 8, IFDEV2_TX_DATA_X1 & 0xff, IFDEV2_TX_DATA_X2 >> 8, (IFDEV2_TX_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { IFDEV2_TX_DATA_Y1 >> 8, IFDEV2_TX_DATA_Y1 & 0xff, IFDEV2_TX_DATA_Y2 >> 8, (IFDEV2_TX_DATA_Y2 - 1) & 0xff, };
     char net_data_string[10];
     char units = 'B';
     int result = 0;
@@ -734,457 +2471,4291 @@ int display_ifdev2_tx_info(long tx_bytes_diff, uint16_t text_color, uint16_t win
         tx_bytes_diff /= 1024 * 1024;
         units = 'M';
     }
-    else if (999 < tx_bytes_diff) {
-        tx_bytes_diff /= 1024;
-        units = 'K';
+    else if (999 < tx_bytes_diff) {
+        tx_bytes_diff /= 1024;
+        units = 'K';
+    }
+
+    sprintf(net_data_string, "%3ld%c", tx_bytes_diff, units);
+    result += write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+/* Every proc and sys read is appended to the trace as a record header, the path and */
+/* the bytes returned, in host byte order. The reads of a tick are buffered and     */
+/* written with a single write when the next tick starts.                            */
+void trace_write(void) {
+    if (trace_length && write(trace_fd, trace_buffer, trace_length) < 0) {
+        write_error("Failed to write the trace file");
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    trace_length = 0;
+}
+
+void trace_append(uint8_t kind, uint16_t value, const char* path, const void* data, ssize_t length) {
+    struct trace_record record = { 0, length, kind, 0, value, };
+    size_t path_length = path == NULL ? 0 : strnlen(path, UINT8_MAX);
+    size_t size;
+
+    if (trace_fd < 0)
+        return;
+    record.time = monotonic_time_ms() - trace_start_time;
+    if (TRACE_BUFFER_SIZE - sizeof(record) - path_length < (size_t)(0 < length ? length : 0))
+        record.length = length = -1;
+    record.path_length = path_length;
+    size = sizeof(record) + path_length + (0 < length ? length : 0);
+    if (TRACE_BUFFER_SIZE - trace_length < size)
+        trace_write();
+    memcpy(trace_buffer + trace_length, &record, sizeof(record));
+    memcpy(trace_buffer + trace_length + sizeof(record), path, path_length);
+    if (0 < length)
+        memcpy(trace_buffer + trace_length + sizeof(record) + path_length, data, length);
+    trace_length += size;
+}
+
+void trace_event(uint8_t kind, uint16_t value) {
+    int64_t current_time = time(NULL);
+
+    if (trace_fd < 0)
+        return;
+    trace_write();
+    trace_append(kind, value, NULL, &current_time, sizeof(current_time));
+}
+
+/* A record whose path or data would run past the end of the file is rejected with */
+/* 0, no record can start there since the file begins with the magic string.        */
+size_t trace_next(size_t offset) {
+    struct trace_record record;
+    size_t next;
+
+    if (trace_size < offset + sizeof(record))
+        return 0;
+    memcpy(&record, trace_data + offset, sizeof(record));
+    next = offset + sizeof(record) + record.path_length + (0 < record.length ? record.length : 0);
+    return next <= trace_size ? next : 0;
+}
+
+/* Reads are looked up in the block of the tick being replayed, starting after the  */
+/* previous match since the collectors read in the same order as when recording.    */
+ssize_t trace_replay_read(const char* path, void* buffer, size_t buffer_size) {
+    struct trace_record record;
+    size_t path_length = strlen(path);
+    size_t offset = trace_cursor;
+    size_t end = trace_block_end;
+    size_t size;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (; offset < end; offset = trace_next(offset)) {
+            memcpy(&record, trace_data + offset, sizeof(record));
+            if (record.kind != TRACE_READ || record.path_length != path_length || memcmp(trace_data + offset + sizeof(record), path, path_length) != 0)
+                continue;
+            trace_cursor = trace_next(offset);
+            if (record.length < 0)
+                return -1;
+            size = (size_t)record.length < buffer_size ? (size_t)record.length : buffer_size;
+            memcpy(buffer, trace_data + offset + sizeof(record) + path_length, size);
+            return size;
+        }
+        offset = trace_block_start;
+        end = trace_cursor;
+    }
+    return -1;
+}
+
+/* System calls whose results are shown, like statvfs, are recorded as a fixed size */
+/* value under a made up path.                                                     */
+bool trace_value(const char* path, void* value, size_t size, bool valid) {
+    if (trace_replaying)
+        return trace_replay_read(path, value, size) == (ssize_t)size;
+    trace_append(TRACE_READ, 0, path, value, valid ? (ssize_t)size : -1);
+    return valid;
+}
+
+int trace_open(void) {
+    if (trace_record_file[0] == 0)
+        return 0;
+    if ((trace_fd = open(trace_record_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        write_error("Failed to create the trace file");
+        return -1;
+    }
+    trace_start_time = monotonic_time_ms();
+    memcpy(trace_buffer, TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1);
+    trace_length = sizeof(TRACE_MAGIC) - 1;
+    return 0;
+}
+
+void trace_close(void) {
+    if (trace_fd < 0)
+        return;
+    trace_write();
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+/* Proc and sys files are kept open and read again from the start with pread, so the */
+/* file is not opened and closed on every sample.                                    */
+ssize_t read_proc_file(int* fd, const char* path, char* buffer, size_t buffer_size) {
+    ssize_t size;
+
+    if (trace_replaying) {
+        if ((size = trace_replay_read(path, buffer, buffer_size - 1)) < 0)
+            return -1;
+        buffer[size] = 0;
+        return size;
+    }
+    if (*fd < 0 && (*fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        trace_append(TRACE_READ, 0, path, NULL, -1);
+        return -1;
+    }
+    if ((size = pread(*fd, buffer, buffer_size - 1, 0)) < 0) {
+        close(*fd);
+        *fd = -1;
+        trace_append(TRACE_READ, 0, path, NULL, -1);
+        return -1;
+    }
+    buffer[size] = 0;
+    trace_append(TRACE_READ, 0, path, buffer, size);
+    return size;
+}
+
+char* skip_text(char* string_ptr, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+        while (*string_ptr && *string_ptr != ' ')
+            string_ptr++;
+        while (*string_ptr && *string_ptr == ' ')
+            string_ptr++;
+    }
+    return string_ptr;
+}
+
+void format_rate(char* data_string, long bytes) {
+    char units = 'B';
+
+    if (999999999 < bytes) {
+        bytes /= 1024 * 1024 * 1024;
+        units = 'G';
+    }
+    else if (999999 < bytes) {
+        bytes /= 1024 * 1024;
+        units = 'M';
+    }
+    else if (999 < bytes) {
+        bytes /= 1024;
+        units = 'K';
+    }
+    sprintf(data_string, "%3ld%c", bytes, units);
+}
+
+/* Round trip times are kept in microseconds, shown as such below a millisecond,   */
+/* then in milliseconds with one decimal below ten and in seconds above a thousand, */
+/* always in the four characters of the field.                                      */
+void format_rtt(char* data_string, uint32_t rtt) {
+    if (rtt == PROBE_LOST)
+        strcpy(data_string, "lost");
+    else if (rtt < 1000)
+        sprintf(data_string, "%3uu", rtt);
+    else if (rtt < 9950)
+        sprintf(data_string, "%3.1fm", rtt / 1000.0);
+    else if (rtt < 999500)
+        sprintf(data_string, "%3.0fm", rtt / 1000.0);
+    else if (rtt < 9950000)
+        sprintf(data_string, "%3.1fs", rtt / 1000000.0);
+    else if (rtt < 999500000)
+        sprintf(data_string, "%3.0fs", rtt / 1000000.0);
+    else
+        strcpy(data_string, "999s");
+}
+
+void format_count(char* data_string, double count) {
+    if (999999 < count)
+        sprintf(data_string, "%3.0fM", count / 1000000);
+    else if (9999 < count)
+        sprintf(data_string, "%3.0fK", count / 1000);
+    else
+        sprintf(data_string, "%4.0f", count);
+}
+
+void format_fs_size(char* data_string, unsigned long blocks, unsigned long block_size) {
+    double fs_size = (double)blocks * block_size / (1024.0 * 1024.0);
+    char size_label = 'M';
+
+    if (100 < fs_size) {
+        fs_size /= 1024.0;
+        size_label = 'G';
+    }
+    if (100 < fs_size) {
+        fs_size /= 1024.0;
+        size_label = 'T';
+    }
+    sprintf(data_string, "%3.1f%c", fs_size, size_label);
+}
+
+/* Lines of the /proc/net files start with the interface name followed by a colon,  */
+/* returns the text after the colon when the line belongs to the interface.          */
+char* match_interface(char* line, char* ifdev) {
+    char* colon;
+
+    while (*line == ' ')
+        line++;
+    if ((colon = strchr(line, ':')) == NULL || (size_t)(colon - line) != strlen(ifdev) || strncmp(ifdev, line, colon - line) != 0)
+        return NULL;
+    return colon + 1;
+}
+
+bool parse_net_stats(char* net_data_string, char* ifdev, struct net_stats* stats) {
+    char* values;
+
+    if ((values = match_interface(net_data_string, ifdev)) == NULL)
+        return false;
+    return sscanf(values, "%ld %ld %ld %ld %*d %*d %*d %*d %ld %ld %ld %ld", &stats->rx_bytes, &stats->rx_packets, &stats->rx_errs, &stats->rx_drop,
+        &stats->tx_bytes, &stats->tx_packets, &stats->tx_errs, &stats->tx_drop) == 8;
+}
+
+void net_stats_diff(struct net_stats* diff, struct net_stats* current, struct net_stats* previous) {
+    diff->rx_bytes = current->rx_bytes - previous->rx_bytes;
+    diff->rx_packets = current->rx_packets - previous->rx_packets;
+    diff->rx_errs = current->rx_errs - previous->rx_errs;
+    diff->rx_drop = current->rx_drop - previous->rx_drop;
+    diff->tx_bytes = current->tx_bytes - previous->tx_bytes;
+    diff->tx_packets = current->tx_packets - previous->tx_packets;
+    diff->tx_errs = current->tx_errs - previous->tx_errs;
+    diff->tx_drop = current->tx_drop - previous->tx_drop;
+}
+
+char* next_line(char** string_pointer) {
+    char* line = *string_pointer;
+    char* end;
+
+    if (*line == 0)
+        return NULL;
+    if ((end = strchr(line, '\n')) != NULL)
+        *end++ = 0;
+    else
+        end = line + strlen(line);
+    *string_pointer = end;
+    return line;
+}
+
+int collect_net_info(void) {
+    char net_data_string[4096];
+    char* string_pointer = net_data_string;
+    char* line;
+    struct net_stats stats;
+
+    if (read_proc_file(&net_dev_fd, "/proc/net/dev", net_data_string, sizeof(net_data_string)) < 0)
+        return -1;
+    while ((line = next_line(&string_pointer)) != NULL) {
+        if (parse_net_stats(line, ifdev1_id, &stats)) {
+            net_stats_diff(&ifdev1_diff, &stats, &ifdev1_stats);
+            ifdev1_stats = stats;
+        }
+        else if (parse_net_stats(line, ifdev2_id, &stats)) {
+            net_stats_diff(&ifdev2_diff, &stats, &ifdev2_stats);
+            ifdev2_stats = stats;
+        }
+    }
+
+    return 0;
+}
+
+int warm_net_info(void) {
+    char net_data_string[4096];
+    char* string_pointer = net_data_string;
+    char* line;
+
+    memset(&ifdev1_diff, 0, sizeof(ifdev1_diff));
+    memset(&ifdev2_diff, 0, sizeof(ifdev2_diff));
+    if (read_proc_file(&net_dev_fd, "/proc/net/dev", net_data_string, sizeof(net_data_string)) < 0)
+        return -1;
+    while ((line = next_line(&string_pointer)) != NULL) {
+        if (!parse_net_stats(line, ifdev1_id, &ifdev1_stats))
+            parse_net_stats(line, ifdev2_id, &ifdev2_stats);
+    }
+
+    return 0;
+}
+
+int display_net_info(uint16_t rx1_color, uint16_t tx1_color, uint16_t rx2_color, uint16_t tx2_color, uint16_t window_color) {
+    int result = 0;
+
+    if (check_ifdev1) {
+        result += display_ifdev1_rx_info(ifdev1_diff.rx_bytes, rx1_color, window_color);
+        result += display_ifdev1_tx_info(ifdev1_diff.tx_bytes, tx1_color, window_color);
+    }
+    if (check_ifdev2) {
+        result += display_ifdev2_rx_info(ifdev2_diff.rx_bytes, rx2_color, window_color);
+        result += display_ifdev2_tx_info(ifdev2_diff.tx_bytes, tx2_color, window_color);
+    }
+
+    return result;
+}
+
+/* Station info of the associated access point is asked to nl80211 through generic  */
+/* netlink, the family id is resolved once and the request is answered right away.  */
+int nl80211_request(uint16_t type, uint16_t flags, uint8_t command, uint16_t attribute, const void* value, uint16_t value_size) {
+    struct {
+        struct nlmsghdr header;
+        struct genlmsghdr genl;
+        struct nlattr attribute;
+        uint8_t value[32];
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + NLA_ALIGN(value_size));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | flags;
+    request.header.nlmsg_seq = ++nl80211_sequence;
+    request.genl.cmd = command;
+    request.genl.version = 1;
+    request.attribute.nla_len = NLA_HDRLEN + value_size;
+    request.attribute.nla_type = attribute;
+    memcpy(request.value, value, value_size < sizeof(request.value) ? value_size : sizeof(request.value));
+    return send(nl80211_fd, &request, request.header.nlmsg_len, 0) < 0 ? -1 : 0;
+}
+
+struct nlattr* nla_find(void* data, int length, uint16_t type) {
+    struct nlattr* attribute;
+
+    for (attribute = data; NLA_HDRLEN <= length && NLA_HDRLEN <= attribute->nla_len && attribute->nla_len <= length;
+        length -= NLA_ALIGN(attribute->nla_len), attribute = (struct nlattr*)((char*)attribute + NLA_ALIGN(attribute->nla_len)))
+        if ((attribute->nla_type & NLA_TYPE_MASK) == type)
+            return attribute;
+    return NULL;
+}
+
+bool nl80211_open(void) {
+    static uint8_t buffer[NL80211_BUFFER_SIZE];
+    struct timeval timeout = { 0, NL80211_TIMEOUT * 1000, };
+    struct nlmsghdr* header = (struct nlmsghdr*)buffer;
+    struct nlattr* attribute;
+    ssize_t size;
+
+    if (nl80211_family)
+        return 0 < nl80211_family;
+    nl80211_family = -1;
+    if ((nl80211_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0)
+        return false;
+    setsockopt(nl80211_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (nl80211_request(GENL_ID_CTRL, 0, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME)) < 0 ||
+        (size = recv(nl80211_fd, buffer, sizeof(buffer), 0)) < 0 || !NLMSG_OK(header, size) || header->nlmsg_type != GENL_ID_CTRL ||
+        (attribute = nla_find((char*)NLMSG_DATA(header) + GENL_HDRLEN, header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), CTRL_ATTR_FAMILY_ID)) == NULL) {
+        write_log("INFO", "nl80211 is not available, using /proc/net/wireless only");
+        close(nl80211_fd);
+        nl80211_fd = -1;
+        return false;
+    }
+    nl80211_family = *(uint16_t*)((char*)attribute + NLA_HDRLEN);
+    return true;
+}
+
+bool nl80211_station(struct wifi_info* wifi) {
+    static uint8_t buffer[NL80211_BUFFER_SIZE];
+    struct nlmsghdr* header;
+    struct nlattr* info;
+    struct nlattr* attribute;
+    struct nlattr* rate;
+    uint32_t ifindex = wifi->ifindex;
+    bool found = false;
+    bool done = false;
+    ssize_t size;
+
+    if (nl80211_request(nl80211_family, NLM_F_DUMP, NL80211_CMD_GET_STATION, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex)) < 0)
+        return false;
+    while (!done && 0 < (size = recv(nl80211_fd, buffer, sizeof(buffer), 0))) {
+        for (header = (struct nlmsghdr*)buffer; NLMSG_OK(header, size); header = NLMSG_NEXT(header, size)) {
+            if (header->nlmsg_seq != nl80211_sequence)
+                continue;
+            if (header->nlmsg_type == NLMSG_DONE || header->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            if (found || (info = nla_find((char*)NLMSG_DATA(header) + GENL_HDRLEN, header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), NL80211_ATTR_STA_INFO)) == NULL)
+                continue;
+            found = true;
+            if ((attribute = nla_find((char*)info + NLA_HDRLEN, info->nla_len - NLA_HDRLEN, NL80211_STA_INFO_SIGNAL)) != NULL)
+                wifi->signal = *(int8_t*)((char*)attribute + NLA_HDRLEN);
+            if ((attribute = nla_find((char*)info + NLA_HDRLEN, info->nla_len - NLA_HDRLEN, NL80211_STA_INFO_TX_RETRIES)) != NULL)
+                wifi->tx_retries = *(uint32_t*)((char*)attribute + NLA_HDRLEN);
+            if ((attribute = nla_find((char*)info + NLA_HDRLEN, info->nla_len - NLA_HDRLEN, NL80211_STA_INFO_TX_FAILED)) != NULL)
+                wifi->tx_failed = *(uint32_t*)((char*)attribute + NLA_HDRLEN);
+            if ((rate = nla_find((char*)info + NLA_HDRLEN, info->nla_len - NLA_HDRLEN, NL80211_STA_INFO_TX_BITRATE)) != NULL) {
+                if ((attribute = nla_find((char*)rate + NLA_HDRLEN, rate->nla_len - NLA_HDRLEN, NL80211_RATE_INFO_BITRATE32)) != NULL)
+                    wifi->bitrate = *(uint32_t*)((char*)attribute + NLA_HDRLEN);
+                else if ((attribute = nla_find((char*)rate + NLA_HDRLEN, rate->nla_len - NLA_HDRLEN, NL80211_RATE_INFO_BITRATE)) != NULL)
+                    wifi->bitrate = *(uint16_t*)((char*)attribute + NLA_HDRLEN);
+            }
+        }
+    }
+    return found;
+}
+
+bool parse_wireless(char* line, char* ifdev, struct wifi_info* wifi) {
+    char* values;
+
+    if ((values = match_interface(line, ifdev)) == NULL)
+        return false;
+    if (sscanf(values, "%*x %lf %lf %lf %*u %*u %*u %lu", &wifi->link, &wifi->level, &wifi->noise, &wifi->retry) != 4)
+        return false;
+    if (0 < wifi->level)
+        wifi->level -= 256;
+    if (0 < wifi->noise)
+        wifi->noise -= 256;
+    return true;
+}
+
+/* The station counters are recorded in a trace as a fixed size value, like the     */
+/* system calls, since they don't come from a file.                                 */
+void update_station(char* ifdev, struct wifi_info* wifi) {
+    char path[IFNAMSIZ + 10];
+    uint32_t previous_retries = wifi->tx_retries;
+    uint32_t previous_failed = wifi->tx_failed;
+    bool station = wifi->station;
+    int32_t values[4];
+
+    if (wifi->ifindex == 0 && !trace_replaying)
+        wifi->ifindex = if_nametoindex(ifdev);
+    wifi->station = !trace_replaying && wifi->ifindex && nl80211_open() && nl80211_station(wifi);
+    values[0] = wifi->signal;
+    values[1] = wifi->bitrate;
+    values[2] = wifi->tx_retries;
+    values[3] = wifi->tx_failed;
+    snprintf(path, sizeof(path), "nl80211:%s", ifdev);
+    if ((wifi->station = trace_value(path, values, sizeof(values), wifi->station))) {
+        wifi->signal = values[0];
+        wifi->bitrate = values[1];
+        wifi->tx_retries = values[2];
+        wifi->tx_failed = values[3];
+    }
+    wifi->tx_retries_diff = station && wifi->station ? wifi->tx_retries - previous_retries : 0;
+    wifi->tx_failed_diff = station && wifi->station ? wifi->tx_failed - previous_failed : 0;
+}
+
+/* /proc/net/wireless is parsed in a single pass like /proc/net/dev, only the       */
+/* interfaces listed there are asked for their station info.                         */
+int collect_wifi_info(void) {
+    char wireless_string[2048];
+    char* string_pointer = wireless_string;
+    char* line;
+
+    ifdev1_wifi.wireless = false;
+    ifdev2_wifi.wireless = false;
+    if (read_proc_file(&wireless_fd, "/proc/net/wireless", wireless_string, sizeof(wireless_string)) < 0)
+        return -1;
+    while ((line = next_line(&string_pointer)) != NULL) {
+        if (check_ifdev1 && parse_wireless(line, ifdev1_id, &ifdev1_wifi))
+            ifdev1_wifi.wireless = true;
+        else if (check_ifdev2 && parse_wireless(line, ifdev2_id, &ifdev2_wifi))
+            ifdev2_wifi.wireless = true;
+    }
+    if (ifdev1_wifi.wireless)
+        update_station(ifdev1_id, &ifdev1_wifi);
+    if (ifdev2_wifi.wireless)
+        update_station(ifdev2_id, &ifdev2_wifi);
+
+    return 0;
+}
+
+int wifi_signal(struct wifi_info* wifi) {
+    return wifi->station ? wifi->signal : (int)wifi->level;
+}
+
+int signal_bars(struct wifi_info* wifi) {
+    int signal = wifi_signal(wifi);
+
+    return -55 <= signal ? 4 : -67 <= signal ? 3 : -75 <= signal ? 2 : -85 <= signal ? 1 : 0;
+}
+
+/* Four bars next to the interface name, filled from the signal level, nothing is  */
+/* drawn for wired interfaces.                                                      */
+int display_signal_info(uint16_t y, struct wifi_info* wifi, bool alert, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * SIGNAL_WIDTH];
+    uint8_t caset[] = { SIGNAL_X >> 8, SIGNAL_X & 0xff, (SIGNAL_X + SIGNAL_WIDTH - 1) >> 8, (SIGNAL_X + SIGNAL_WIDTH - 1) & 0xff, };
+    uint8_t raset[] = { y >> 8, y & 0xff, (y + FONT_HEIGHT - 1) >> 8, (y + FONT_HEIGHT - 1) & 0xff, };
+    int bars = wifi->wireless ? signal_bars(wifi) : 0;
+    uint16_t bar_color = bars <= 1 || alert ? alert_color_code : data_text_color_code;
+    uint16_t height;
+
+    for (uint16_t row = 0; row < FONT_HEIGHT; row++) {
+        for (uint16_t column = 0; column < SIGNAL_WIDTH; column++) {
+            height = (column / 4 + 1) * 3 + 2;
+            if (!wifi->wireless || column % 4 == 3 || row == FONT_HEIGHT - 1 || row < FONT_HEIGHT - 1 - height)
+                buffer[row * SIGNAL_WIDTH + column] = window_color;
+            else
+                buffer[row * SIGNAL_WIDTH + column] = column / 4 < bars ? bar_color : label_text_color_code;
+        }
+    }
+    return write_rect_to_display(buffer, FONT_HEIGHT * SIGNAL_WIDTH, caset, raset);
+}
+
+int collect_cpu_info(void) {
+    char cpu_avg_string[64];
+
+    if (read_proc_file(&loadavg_fd, "/proc/loadavg", cpu_avg_string, sizeof(cpu_avg_string)) <= 0)
+        return -1;
+    cpu_load = atof(cpu_avg_string);
+
+    return 0;
+}
+
+int display_cpu_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * CPU_DATA_WIDTH];
+    uint8_t caset[] = { CPU_DATA_X1 >> 8, CPU_DATA_X1 & 0xff, CPU_DATA_X2 >> 8, (CPU_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { CPU_DATA_Y1 >> 8, CPU_DATA_Y1 & 0xff, CPU_DATA_Y2 >> 8, (CPU_DATA_Y2 - 1) & 0xff, };
+    char cpu_string[10];
+    int result = 0;
+
+    sprintf(cpu_string, "%3d%%", (int)(cpu_load * 100 / 4));
+    result += write_text_to_display(buffer, FONT_HEIGHT * CPU_DATA_WIDTH, cpu_string, CPU_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+/* The first read parses every line looking for the keys and remembers the line of  */
+/* each one, later reads only parse those lines. If a cached line does not hold its  */
+/* key anymore the whole file is parsed again.                                        */
+int read_keyed_file(struct keyed_file* file) {
+    static char buffer[KEYED_FILE_BUFFER_SIZE];
+    char* string_pointer = buffer;
+    unsigned int found = 0;
+    int line = 0;
+
+    if (read_proc_file(&file->fd, file->path, buffer, sizeof(buffer)) < 0)
+        return -1;
+
+    while (string_pointer != NULL && *string_pointer && found < file->count) {
+        for (unsigned int i = 0; i < file->count; i++) {
+            if (file->indexed && file->lines[i] != line)
+                continue;
+            if (strncmp(string_pointer, file->keys[i], strlen(file->keys[i])) != 0) {
+                if (!file->indexed)
+                    continue;
+                file->indexed = false;
+                return read_keyed_file(file);
+            }
+            file->values[i] = strtoll(string_pointer + strlen(file->keys[i]), NULL, 10);
+            file->lines[i] = line;
+            found++;
+        }
+        if ((string_pointer = strchr(string_pointer, '\n')) != NULL)
+            string_pointer++;
+        line++;
+    }
+    if (found < file->count) {
+        if (file->indexed) {
+            file->indexed = false;
+            return read_keyed_file(file);
+        }
+        return -1;
+    }
+    file->indexed = true;
+
+    return 0;
+}
+
+/* Sections of the snmp and netstat files are a header row with the column names    */
+/* followed by a row with the values. The first read looks up the value row and the  */
+/* column of each key, later reads only parse those rows. If a cached row does not   */
+/* start with its section anymore the lookup is done again.                          */
+bool index_table_file(struct table_file* file, char* buffer) {
+    char* string_pointer = buffer;
+    char* token;
+    size_t section_length;
+    size_t name_length;
+    unsigned int found = 0;
+    int line = 0;
+
+    for (unsigned int i = 0; i < file->count; i++)
+        file->lines[i] = -1;
+    while (string_pointer != NULL && *string_pointer && found < file->count) {
+        for (unsigned int i = 0; i < file->count; i++) {
+            section_length = strchr(file->keys[i], ' ') - file->keys[i];
+            if (file->lines[i] != -1 || strncmp(string_pointer, file->keys[i], section_length) != 0)
+                continue;
+            name_length = strlen(file->keys[i] + section_length + 1);
+            token = string_pointer + section_length;
+            for (int column = 0; *token == ' '; column++) {
+                token++;
+                if (strncmp(token, file->keys[i] + section_length + 1, name_length) == 0 && (token[name_length] == ' ' || token[name_length] == '\n')) {
+                    file->lines[i] = line + 1;
+                    file->columns[i] = column;
+                    found++;
+                    break;
+                }
+                token += strcspn(token, " \n");
+            }
+        }
+        if ((string_pointer = strchr(string_pointer, '\n')) != NULL)
+            string_pointer++;
+        line++;
+    }
+    file->indexed = found == file->count;
+
+    return file->indexed;
+}
+
+int read_table_file(struct table_file* file) {
+    static char buffer[KEYED_FILE_BUFFER_SIZE];
+    char* string_pointer = buffer;
+    char* token;
+    size_t section_length;
+    unsigned int found = 0;
+    int line = 0;
+
+    if (read_proc_file(&file->fd, file->path, buffer, sizeof(buffer)) < 0)
+        return -1;
+    if (!file->indexed && !index_table_file(file, buffer))
+        return -1;
+
+    while (string_pointer != NULL && *string_pointer && found < file->count) {
+        for (unsigned int i = 0; i < file->count; i++) {
+            if (file->lines[i] != line)
+                continue;
+            section_length = strchr(file->keys[i], ' ') - file->keys[i];
+            if (strncmp(string_pointer, file->keys[i], section_length) != 0) {
+                file->indexed = false;
+                return index_table_file(file, buffer) ? read_table_file(file) : -1;
+            }
+            token = string_pointer + section_length;
+            for (int column = 0; column < file->columns[i] && *token == ' '; column++)
+                token += 1 + strcspn(token + 1, " \n");
+            file->values[i] = strtoll(token, NULL, 10);
+            found++;
+        }
+        if ((string_pointer = strchr(string_pointer, '\n')) != NULL)
+            string_pointer++;
+        line++;
+    }
+    if (found < file->count) {
+        file->indexed = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+double counter_rate(long long current, long long previous, long long elapsed) {
+    return 0 < elapsed && previous <= current ? (current - previous) * 1000.0 / elapsed : 0;
+}
+
+int collect_tcp_info(void) {
+    char buffer[512];
+    char* string_pointer;
+    long long current_time = monotonic_time_ms();
+    long long elapsed = tcp_sample_time == 0 ? 0 : current_time - tcp_sample_time;
+    int result = -1;
+
+    if (read_table_file(&snmp) == 0) {
+        tcp_established = snmp.values[SNMP_TCP_CURR_ESTAB];
+        tcp_retrans_rate = counter_rate(snmp.values[SNMP_TCP_RETRANS_SEGS], tcp_retrans_segs, elapsed);
+        tcp_retrans_percent = tcp_out_segs < snmp.values[SNMP_TCP_OUT_SEGS] && 0 < elapsed ?
+            (snmp.values[SNMP_TCP_RETRANS_SEGS] - tcp_retrans_segs) * 100.0 / (snmp.values[SNMP_TCP_OUT_SEGS] - tcp_out_segs) : 0;
+        udp_error_rate = counter_rate(snmp.values[SNMP_UDP_IN_ERRORS] + snmp.values[SNMP_UDP_RCVBUF_ERRORS], udp_in_errors, elapsed);
+        tcp_out_segs = snmp.values[SNMP_TCP_OUT_SEGS];
+        tcp_retrans_segs = snmp.values[SNMP_TCP_RETRANS_SEGS];
+        udp_in_errors = snmp.values[SNMP_UDP_IN_ERRORS] + snmp.values[SNMP_UDP_RCVBUF_ERRORS];
+        result = 0;
+    }
+    if (read_table_file(&netstat) == 0) {
+        tcp_listen_overflow_rate = counter_rate(netstat.values[NETSTAT_LISTEN_OVERFLOWS], tcp_listen_overflows, elapsed);
+        tcp_listen_drop_rate = counter_rate(netstat.values[NETSTAT_LISTEN_DROPS], tcp_listen_drops, elapsed);
+        tcp_listen_overflows = netstat.values[NETSTAT_LISTEN_OVERFLOWS];
+        tcp_listen_drops = netstat.values[NETSTAT_LISTEN_DROPS];
+    }
+    if (read_proc_file(&sockstat_fd, "/proc/net/sockstat", buffer, sizeof(buffer)) >= 0 && (string_pointer = strstr(buffer, "TCP: ")) != NULL)
+        sscanf(string_pointer, "TCP: inuse %*d orphan %ld tw %ld", &tcp_orphan, &tcp_time_wait);
+    tcp_sample_time = current_time;
+
+    return result;
+}
+
+int warm_tcp_info(void) {
+    tcp_sample_time = 0;
+    return collect_tcp_info();
+}
+
+/* The CPU columns of the interrupts and softirqs files are counted from the header  */
+/* line once, and counted again only when its length changes, as when a CPU goes     */
+/* offline. Each file is parsed in a single pass into the per CPU totals and, for    */
+/* the interrupts, into flat tables of counters and rates kept by row. A row whose   */
+/* IRQ changed restarts its counter instead of giving a bogus rate.                  */
+void count_cpu_columns(char* header, size_t* header_length, unsigned int* cpus) {
+    if (*header_length == strlen(header))
+        return;
+    *header_length = strlen(header);
+    for (*cpus = 0; *cpus < MAX_CPUS && (header = strstr(header, "CPU")) != NULL; header += 3)
+        (*cpus)++;
+}
+
+long long parse_cpu_columns(char** string_pointer, unsigned int cpus, long long* values) {
+    long long total = 0;
+    char* end;
+
+    for (unsigned int i = 0; i < cpus; i++) {
+        values[i] = strtoll(*string_pointer, &end, 10);
+        if (end == *string_pointer) {
+            memset(values + i, 0, (cpus - i) * sizeof(values[0]));
+            break;
+        }
+        *string_pointer = end;
+        total += values[i];
+    }
+    return total;
+}
+
+void update_core_rates(long long* counts, double* rates, long long* current, unsigned int cpus, long long elapsed) {
+    for (unsigned int i = 0; i < cpus; i++) {
+        rates[i] = counter_rate(current[i], counts[i], elapsed);
+        counts[i] = current[i];
+    }
+}
+
+int collect_interrupts(long long elapsed) {
+    static char buffer[IRQ_BUFFER_SIZE];
+    long long core_counts[MAX_CPUS] = { 0, };
+    long long values[MAX_CPUS];
+    char* string_pointer = buffer;
+    char* line;
+    char* name;
+    unsigned int row = 0;
+    long long total;
+
+    if (read_proc_file(&interrupts_fd, "/proc/interrupts", buffer, sizeof(buffer)) <= 0 || (line = next_line(&string_pointer)) == NULL)
+        return -1;
+    count_cpu_columns(line, &interrupts_header, &interrupts_cpus);
+    while ((line = next_line(&string_pointer)) != NULL && row < MAX_IRQS) {
+        if ((name = strchr(line, ':')) == NULL)
+            continue;
+        *name++ = '\0';
+        while (*line == ' ')
+            line++;
+        total = parse_cpu_columns(&name, interrupts_cpus, values);
+        for (unsigned int i = 0; i < interrupts_cpus; i++)
+            core_counts[i] += values[i];
+        if (row < irqs_count && strncmp(irq_ids[row], line, IRQ_ID_SIZE - 1) == 0)
+            irq_rates[row] = counter_rate(total, irq_counts[row], elapsed);
+        else {
+            snprintf(irq_ids[row], IRQ_ID_SIZE, "%s", line);
+            if (isdigit(line[0]) && (name = strrchr(name, ' ')) != NULL)
+                line = name + 1;
+            snprintf(irq_names[row], IRQ_NAME_SIZE, "%s", line);
+            irq_rates[row] = 0;
+        }
+        irq_counts[row++] = total;
+    }
+    irqs_count = row;
+    update_core_rates(irq_core_counts, irq_core_rates, core_counts, interrupts_cpus, elapsed);
+
+    return 0;
+}
+
+int collect_softirqs(long long elapsed) {
+    char buffer[2048];
+    long long core_counts[MAX_CPUS] = { 0, };
+    long long values[MAX_CPUS];
+    char* string_pointer = buffer;
+    unsigned int cpus;
+    char* line;
+    char* counts;
+
+    if (read_proc_file(&softirqs_fd, "/proc/softirqs", buffer, sizeof(buffer)) <= 0 || (line = next_line(&string_pointer)) == NULL)
+        return -1;
+    cpus = softirqs_cpus;
+    count_cpu_columns(line, &softirqs_header, &softirqs_cpus);
+    if (softirqs_cpus != cpus)
+        background_version++;
+    while ((line = next_line(&string_pointer)) != NULL) {
+        if ((counts = strchr(line, ':')) == NULL)
+            continue;
+        *counts++ = '\0';
+        parse_cpu_columns(&counts, softirqs_cpus, values);
+        for (unsigned int i = 0; i < softirqs_cpus; i++)
+            core_counts[i] += values[i];
+        if (strcmp(line + strspn(line, " "), "NET_RX") == 0)
+            update_core_rates(net_rx_core_counts, net_rx_core_rates, values, softirqs_cpus, elapsed);
+    }
+    update_core_rates(softirq_core_counts, softirq_core_rates, core_counts, softirqs_cpus, elapsed);
+
+    return 0;
+}
+
+int collect_irq_info(void) {
+    long long current_time = monotonic_time_ms();
+    long long elapsed = irq_sample_time == 0 ? 0 : current_time - irq_sample_time;
+    int result = -1;
+
+    if (read_keyed_file(&proc_stat) == 0) {
+        ctxt_rate = counter_rate(proc_stat.values[PROC_STAT_CTXT], ctxt_count, elapsed);
+        ctxt_count = proc_stat.values[PROC_STAT_CTXT];
+        result = 0;
+    }
+    if (collect_interrupts(elapsed) == 0 && collect_softirqs(elapsed) == 0)
+        result = 0;
+    irq_sample_time = current_time;
+
+    return result;
+}
+
+int warm_irq_info(void) {
+    irq_sample_time = 0;
+    return collect_irq_info();
+}
+
+double slice_wait(unsigned long long run_delay, unsigned long long previous_delay, unsigned long long timeslices, unsigned long long previous_slices) {
+    return previous_slices < timeslices && previous_delay <= run_delay ? (run_delay - previous_delay) / 1000.0 / (timeslices - previous_slices) : 0;
+}
+
+/* For each core /proc/schedstat gives the nanoseconds runnable tasks waited for it  */
+/* and the timeslices it ran, the same two counters are in the schedstat file of a   */
+/* process. The wait per timeslice and the milliseconds waited per second come from  */
+/* the differences between two reads, the files are kept open and read in place.    */
+int collect_sched_info(void) {
+    static char buffer[SCHEDSTAT_BUFFER_SIZE];
+    long long current_time = monotonic_time_ms();
+    long long elapsed = sched_sample_time == 0 ? 0 : current_time - sched_sample_time;
+    unsigned long long run_delay, timeslices;
+    struct daemon* daemon;
+    char path[32];
+    char* line;
+    unsigned int cpu;
+    int result = -1;
+
+    if (read_proc_file(&schedstat_fd, "/proc/schedstat", buffer, sizeof(buffer)) >= 0) {
+        for (line = buffer; (line = strstr(line, "\ncpu")) != NULL; line++) {
+            if (sscanf(line + 1, "cpu%u %*u %*u %*u %*u %*u %*u %*u %llu %llu", &cpu, &run_delay, &timeslices) != 3 || MAX_CPUS <= cpu)
+                continue;
+            sched_delay_rates[cpu] = counter_rate(run_delay, sched_run_delays[cpu], elapsed) / 1000000;
+            sched_slice_waits[cpu] = elapsed ? slice_wait(run_delay, sched_run_delays[cpu], timeslices, sched_timeslices[cpu]) : 0;
+            sched_run_delays[cpu] = run_delay;
+            sched_timeslices[cpu] = timeslices;
+            if (sched_cpus <= cpu)
+                sched_cpus = cpu + 1;
+        }
+        result = 0;
+    }
+    for (unsigned int i = 0; i < daemons_count; i++) {
+        daemon = &daemons[i];
+        snprintf(path, sizeof(path), "/proc/%d/schedstat", daemon->pid);
+        if (!daemon->up || read_proc_file(&daemon->sched_fd, path, buffer, sizeof(buffer)) < 0 || sscanf(buffer, "%*u %llu %llu", &run_delay, &timeslices) != 2)
+            continue;
+        daemon->slice_wait = elapsed && daemon->timeslices ? slice_wait(run_delay, daemon->run_delay, timeslices, daemon->timeslices) : 0;
+        daemon->run_delay = run_delay;
+        daemon->timeslices = timeslices;
+    }
+    sched_sample_time = current_time;
+
+    return result;
+}
+
+int warm_sched_info(void) {
+    sched_sample_time = 0;
+    return collect_sched_info();
+}
+
+int collect_ram_info(void) {
+    long long current_time = monotonic_time_ms();
+    long long elapsed = current_time - swap_sample_time;
+
+    if (read_keyed_file(&meminfo) < 0 || meminfo.values[MEMINFO_TOTAL] == 0)
+        return -1;
+    ram_used = (int)(100 - (meminfo.values[MEMINFO_AVAILABLE] * 100 / meminfo.values[MEMINFO_TOTAL]));
+
+    if (read_keyed_file(&vmstat) == 0) {
+        if (swap_sample_time != 0 && 0 < elapsed) {
+            swap_in_rate = (vmstat.values[VMSTAT_PSWPIN] - swap_in_pages) * 1000.0 / elapsed;
+            swap_out_rate = (vmstat.values[VMSTAT_PSWPOUT] - swap_out_pages) * 1000.0 / elapsed;
+        }
+        swap_in_pages = vmstat.values[VMSTAT_PSWPIN];
+        swap_out_pages = vmstat.values[VMSTAT_PSWPOUT];
+        swap_sample_time = current_time;
+    }
+
+    return 0;
+}
+
+int warm_ram_info(void) {
+    swap_sample_time = 0;
+    swap_in_rate = 0;
+    swap_out_rate = 0;
+    return collect_ram_info();
+}
+
+int display_ram_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * RAM_DATA_WIDTH];
+    uint8_t caset[] = { RAM_DATA_X1 >> 8, RAM_DATA_X1 & 0xff, RAM_DATA_X2 >> 8, (RAM_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { RAM_DATA_Y1 >> 8, RAM_DATA_Y1 & 0xff, RAM_DATA_Y2 >> 8, (RAM_DATA_Y2 - 1) & 0xff, };
+    char ram_string[10];
+    int result = 0;
+
+    sprintf(ram_string, "%3d%%", ram_used);
+    result += write_text_to_display(buffer, FONT_HEIGHT * RAM_DATA_WIDTH, ram_string, RAM_DATA_LENGHT, text_color, window_color, caset, raset);
+    result += write_text_field(RAM_FLAG_X1, RAM_DATA_Y1, 0 < swap_in_rate + swap_out_rate ? "S" : " ", 1, alert_color_code, window_color);
+
+    return result;
+}
+
+bool read_sysfs_value(int* fd, const char* path, long* value, int base) {
+    char value_string[32];
+
+    if (read_proc_file(fd, path, value_string, sizeof(value_string)) <= 0)
+        return false;
+    *value = strtol(value_string, NULL, base);
+    return true;
+}
+
+bool read_sysfs_string(const char* path, char* value_string, size_t size) {
+    int fd = -1;
+    ssize_t length = read_proc_file(&fd, path, value_string, size);
+
+    if (0 <= fd)
+        close(fd);
+    if (length <= 0)
+        return false;
+    value_string[strcspn(value_string, "\n")] = 0;
+    return true;
+}
+
+void add_thermal_sensor(char* name, char* path) {
+    struct thermal_sensor* sensor = &thermal_sensors[thermal_sensors_count];
+
+    if (THERMAL_SENSORS <= thermal_sensors_count || access(path, R_OK) != 0)
+        return;
+    snprintf(sensor->name, sizeof(sensor->name), "%s", name);
+    snprintf(sensor->path, sizeof(sensor->path), "%s", path);
+    sensor->fd = -1;
+    sensor->value = 0;
+    thermal_sensors_count++;
+}
+
+/* Thermal zones come first, so thermal_zone0 is always the first sensor. The hwmon  */
+/* devices add the sensors not exposed as zones, and the Raspberry Pi voltage        */
+/* monitor provides the under-voltage alarm when the firmware flags are missing.     */
+void init_thermal_sensors(void) {
+    char sensor_name[24];
+    char hwmon_name[24];
+    char path[64];
+
+    thermal_sensors_ready = true;
+    for (int i = 0; thermal_sensors_count < THERMAL_SENSORS; i++) {
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/type", i);
+        if (!read_sysfs_string(path, sensor_name, sizeof(sensor_name)))
+            break;
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", i);
+        add_thermal_sensor(sensor_name, path);
+    }
+    for (int i = 0; thermal_sensors_count < THERMAL_SENSORS; i++) {
+        snprintf(path, sizeof(path), "/sys/class/hwmon/hwmon%d/name", i);
+        if (!read_sysfs_string(path, hwmon_name, sizeof(hwmon_name)))
+            break;
+        if (strcmp(hwmon_name, "rpi_volt") == 0) {
+            snprintf(undervoltage_path, sizeof(undervoltage_path), "/sys/class/hwmon/hwmon%d/in0_lcrit_alarm", i);
+            continue;
+        }
+        for (int j = 1; j <= THERMAL_SENSORS; j++) {
+            snprintf(path, sizeof(path), "/sys/class/hwmon/hwmon%d/temp%d_input", i, j);
+            snprintf(sensor_name, sizeof(sensor_name), j == 1 ? "%.20s" : "%.18s/%d", hwmon_name, j);
+            add_thermal_sensor(sensor_name, path);
+        }
+    }
+}
+
+int collect_temp_info(void) {
+    long value;
+    int result = -1;
+
+    if (!thermal_sensors_ready)
+        init_thermal_sensors();
+
+    for (unsigned int i = 0; i < thermal_sensors_count; i++)
+        if (read_sysfs_value(&thermal_sensors[i].fd, thermal_sensors[i].path, &thermal_sensors[i].value, 10) && i == 0) {
+            temp_value = thermal_sensors[i].value;
+            result = 0;
+        }
+
+    throttled_flags_ready = read_sysfs_value(&throttled_fd, "/sys/devices/platform/soc/soc:firmware/get_throttled", &value, 16);
+    throttled_flags = throttled_flags_ready ? (unsigned int)value : 0;
+    if (undervoltage_path[0] && read_sysfs_value(&undervoltage_fd, undervoltage_path, &value, 10) && value != 0)
+        throttled_flags |= THROTTLE_UNDERVOLTAGE;
+
+    return result;
+}
+
+char throttle_indicator(void) {
+    if (throttled_flags & THROTTLE_UNDERVOLTAGE)
+        return 'U';
+    if ((throttled_flags & (THROTTLE_FREQ_CAPPED | THROTTLE_THROTTLED | THROTTLE_SOFT_LIMIT)) || freq_capped)
+        return 'T';
+    return ' ';
+}
+
+int display_temp_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * TEMP_DATA_WIDTH];
+    uint8_t caset[] = { TEMP_DATA_X1 >> 8, TEMP_DATA_X1 & 0xff, TEMP_DATA_X2 >> 8, (TEMP_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { TEMP_DATA_Y1 >> 8, TEMP_DATA_Y1 & 0xff, TEMP_DATA_Y2 >> 8, (TEMP_DATA_Y2 - 1) & 0xff, };
+    char temp_string[20];
+    char flag_string[2] = { throttle_indicator(), 0, };
+    int result = 0;
+
+    sprintf(temp_string, "%3ld", temp_value / 1000);
+    result += write_text_to_display(buffer, FONT_HEIGHT * TEMP_DATA_WIDTH, temp_string, TEMP_DATA_LENGHT, text_color, window_color, caset, raset);
+    result += write_text_field(TEMP_FLAG_X1, TEMP_DATA_Y1, flag_string, 1, alert_color_code, window_color);
+
+    return result;
+}
+
+int collect_uptime_info(void) {
+    char uptime_data_string[64];
+
+    if (read_proc_file(&uptime_fd, "/proc/uptime", uptime_data_string, sizeof(uptime_data_string)) <= 0)
+        return -1;
+    uptime_value = atol(uptime_data_string);
+
+    return 0;
+}
+
+int display_uptime_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * UPT_DATA_WIDTH];
+    uint8_t caset[] = { UPT_DATA_X1 >> 8, UPT_DATA_X1 & 0xff, UPT_DATA_X2 >> 8, (UPT_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { UPT_DATA_Y1 >> 8, UPT_DATA_Y1 & 0xff, UPT_DATA_Y2 >> 8, (UPT_DATA_Y2 - 1) & 0xff, };
+    char uptime_string[20];
+    time_t uptime = uptime_value;
+    int result = 0;
+
+    int d = (uptime / (24 * 3600));
+    uptime %= (24 * 3600);
+    int h = (uptime / 3600);
+    uptime %= 3600;
+    if (0 < d)
+        sprintf(uptime_string, "%3d:%02d:%02dD", d, h, (int)(uptime / 60));
+    else
+        sprintf(uptime_string, " %02d:%02d:%02dH", h, (int)(uptime / 60), (int)(uptime % 60));
+    result += write_text_to_display(buffer, FONT_HEIGHT * UPT_DATA_WIDTH, uptime_string, UPT_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+/* Only the fields shown are recorded in a trace, as 64 bit values, so it can be     */
+/* replayed on a system with a different statvfs layout.                             */
+bool read_fs_stat(const char* fs, struct statvfs* stat) {
+    char path[sizeof(fs1_id) + 8];
+    uint64_t values[6];
+    bool valid;
+
+    if (trace_fd < 0 && !trace_replaying)
+        return statvfs(fs, stat) == 0;
+    snprintf(path, sizeof(path), "statvfs:%s", fs);
+    if ((valid = !trace_replaying && statvfs(fs, stat) == 0)) {
+        values[0] = stat->f_frsize;
+        values[1] = stat->f_blocks;
+        values[2] = stat->f_bfree;
+        values[3] = stat->f_bavail;
+        values[4] = stat->f_files;
+        values[5] = stat->f_ffree;
+    }
+    if (!trace_value(path, values, sizeof(values), valid))
+        return false;
+    if (trace_replaying) {
+        memset(stat, 0, sizeof(struct statvfs));
+        stat->f_frsize = values[0];
+        stat->f_blocks = values[1];
+        stat->f_bfree = values[2];
+        stat->f_bavail = values[3];
+        stat->f_files = values[4];
+        stat->f_ffree = values[5];
+    }
+    return true;
+}
+
+int collect_fs_info(void) {
+    bool previous_sda = check_sda;
+    bool previous_sdb = check_sdb;
+    fsblkcnt_t previous_fs1_blocks = fs1_stat.f_blocks;
+    fsblkcnt_t previous_fs2_blocks = fs2_stat.f_blocks;
+
+    check_sda = read_fs_stat(fs1_id, &fs1_stat) && fs1_stat.f_blocks != 0;
+    check_sdb = read_fs_stat(fs2_id, &fs2_stat) && fs2_stat.f_blocks != 0;
+    if (check_sda != previous_sda || check_sdb != previous_sdb || fs1_stat.f_blocks != previous_fs1_blocks || fs2_stat.f_blocks != previous_fs2_blocks)
+        background_version++;
+    return check_sda || check_sdb ? 0 : -1;
+}
+
+int display_fs1_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * FS1_DATA_WIDTH];
+    uint8_t caset[] = { FS1_DATA_X1 >> 8, FS1_DATA_X1 & 0xff, FS1_DATA_X2 >> 8, (FS1_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { FS1_DATA_Y1 >> 8, FS1_DATA_Y1 & 0xff, FS1_DATA_Y2 >> 8, (FS1_DATA_Y2 - 1) & 0xff, };
+    char fs1_string[20];
+    int result = 0;
+
+    sprintf(fs1_string, "%3d%%", (int)((fs1_stat.f_blocks - fs1_stat.f_bfree) * 100 / fs1_stat.f_blocks));
+    result += write_text_to_display(buffer, FONT_HEIGHT * FS1_DATA_WIDTH, fs1_string, FS1_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+int display_fs2_info(uint16_t text_color, uint16_t window_color) {
+    static uint16_t buffer[FONT_HEIGHT * FS2_DATA_WIDTH];
+    uint8_t caset[] = { FS2_DATA_X1 >> 8, FS2_DATA_X1 & 0xff, FS2_DATA_X2 >> 8, (FS2_DATA_X2 - 1) & 0xff, };
+    uint8_t raset[] = { FS2_DATA_Y1 >> 8, FS2_DATA_Y1 & 0xff, FS2_DATA_Y2 >> 8, (FS2_DATA_Y2 - 1) & 0xff, };
+    char fs2_string[20];
+    int result = 0;
+
+    sprintf(fs2_string, "%3d%%", (int)((fs2_stat.f_blocks - fs2_stat.f_bfree) * 100 / fs2_stat.f_blocks));
+    result += write_text_to_display(buffer, FONT_HEIGHT * FS2_DATA_WIDTH, fs2_string, FS2_DATA_LENGHT, text_color, window_color, caset, raset);
+
+    return result;
+}
+
+int display_fs_io_info(struct disk_info* disk, struct statvfs* stat, uint16_t y, uint16_t text_color, uint16_t fixed_text_color, uint16_t window_color) {
+    char rate_string[20];
+    char io_string[20];
+
+    if (!disk->ready || disk->read_rate + disk->write_rate < 1) {
+        format_fs_size(io_string, stat->f_blocks, stat->f_frsize);
+        return write_text_field(FS1_FIXED_X1, y, io_string, FS_IO_LENGHT, fixed_text_color, window_color);
+    }
+    format_rate(rate_string, (long)(disk->read_rate + disk->write_rate));
+    sprintf(io_string, "%s/s", rate_string);
+    return write_text_field(FS1_FIXED_X1, y, io_string, FS_IO_LENGHT, text_color, window_color);
+}
+
+void init_cpu_freqs(void) {
+    char path[64];
+    int fd = -1;
+
+    cpu_freqs_ready = true;
+    for (int i = 0; cpu_freqs_count < MAX_CPUS; i++) {
+        struct cpu_freq* cpu = &cpu_freqs[cpu_freqs_count];
+        snprintf(cpu->cur_path, sizeof(cpu->cur_path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+        snprintf(cpu->max_path, sizeof(cpu->max_path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_max_freq", i);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+        if (!read_sysfs_value(&fd, path, &cpu->hw_max, 10))
+            break;
+        close(fd);
+        fd = -1;
+        cpu->cur_fd = -1;
+        cpu->max_fd = -1;
+        cpu_freqs_count++;
+    }
+}
+
+/* The frequency is considered capped when the policy limit of a core is below the    */
+/* hardware maximum, this is how the thermal framework throttles through cpufreq.     */
+int collect_freq_info(void) {
+    int result = -1;
+
+    if (!cpu_freqs_ready)
+        init_cpu_freqs();
+
+    freq_capped = false;
+    for (unsigned int i = 0; i < cpu_freqs_count; i++) {
+        if (read_sysfs_value(&cpu_freqs[i].cur_fd, cpu_freqs[i].cur_path, &cpu_freqs[i].cur, 10))
+            result = 0;
+        if (read_sysfs_value(&cpu_freqs[i].max_fd, cpu_freqs[i].max_path, &cpu_freqs[i].max, 10) && cpu_freqs[i].max < cpu_freqs[i].hw_max)
+            freq_capped = true;
+    }
+
+    return result;
+}
+
+/* The pids are listed as null separated names, so the list can be recorded in a    */
+/* trace like the contents of a file.                                                */
+ssize_t read_proc_pids(char* buffer, size_t buffer_size) {
+    struct dirent* entry;
+    size_t size = 0;
+    size_t length;
+    DIR* dir;
+
+    if (trace_replaying)
+        return trace_replay_read("/proc", buffer, buffer_size);
+    if ((dir = opendir("/proc")) == NULL)
+        return -1;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!isdigit(entry->d_name[0]))
+            continue;
+        length = strlen(entry->d_name) + 1;
+        if (buffer_size < size + length)
+            break;
+        memcpy(buffer + size, entry->d_name, length);
+        size += length;
+    }
+    closedir(dir);
+    trace_append(TRACE_READ, 0, "/proc", buffer, size);
+
+    return size;
+}
+
+/* The process table keeps the cpu ticks of every pid seen on the previous scan, two  */
+/* tables are swapped on every scan. procfs lists the pids in ascending order, so the */
+/* previous table is walked with a single cursor instead of searching it for each pid.*/
+int scan_processes(bool rank) {
+    unsigned int previous = proc_table;
+    unsigned int current = proc_table ^ 1;
+    unsigned int cursor = 0;
+    static char pids_string[PROC_LIST_SIZE];
+    char stat_string[512];
+    char path[32];
+    unsigned long utime, stime, ticks, diff;
+    char* name_start;
+    char* name_end;
+    char* entry;
+    ssize_t pids_size;
+    ssize_t size;
+    char state;
+    pid_t pid;
+    int fd;
+
+    if ((pids_size = read_proc_pids(pids_string, sizeof(pids_string))) < 0) {
+        write_error("Failed to open /proc");
+        return -1;
+    }
+
+    proc_count[current] = 0;
+    processes_total = 0;
+    processes_running = 0;
+    processes_blocked = 0;
+    top_processes_count = 0;
+    for (entry = pids_string; entry < pids_string + pids_size; entry += strlen(entry) + 1) {
+        snprintf(path, sizeof(path), "/proc/%s/stat", entry);
+        fd = -1;
+        size = read_proc_file(&fd, path, stat_string, sizeof(stat_string));
+        if (0 <= fd)
+            close(fd);
+        if (size <= 0)
+            continue;
+        if ((name_start = strchr(stat_string, '(')) == NULL || (name_end = strrchr(stat_string, ')')) == NULL)
+            continue;
+        if (sscanf(name_end + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &state, &utime, &stime) != 3)
+            continue;
+
+        pid = atoi(entry);
+        ticks = utime + stime;
+        processes_total++;
+        if (state == 'R')
+            processes_running++;
+        else if (state == 'D')
+            processes_blocked++;
+        if (proc_count[current] < PROC_TABLE_SIZE) {
+            proc_pids[current][proc_count[current]] = pid;
+            proc_ticks[current][proc_count[current]] = ticks;
+            proc_count[current]++;
+        }
+        if (!rank)
+            continue;
+
+        while (cursor < proc_count[previous] && proc_pids[previous][cursor] < pid)
+            cursor++;
+        if (cursor == proc_count[previous] || proc_pids[previous][cursor] != pid || ticks < proc_ticks[previous][cursor])
+            continue;
+        diff = ticks - proc_ticks[previous][cursor];
+        if (diff == 0 || (top_processes_count == TOP_PROCESSES && diff <= top_processes[TOP_PROCESSES - 1].ticks))
+            continue;
+
+        unsigned int position = top_processes_count < TOP_PROCESSES ? top_processes_count++ : TOP_PROCESSES - 1;
+        while (0 < position && top_processes[position - 1].ticks < diff) {
+            top_processes[position] = top_processes[position - 1];
+            position--;
+        }
+        top_processes[position].pid = pid;
+        top_processes[position].ticks = diff;
+        size = name_end - name_start - 1 < 15 ? name_end - name_start - 1 : 15;
+        memcpy(top_processes[position].name, name_start + 1, size);
+        top_processes[position].name[size] = 0;
+    }
+    proc_table = current;
+
+    return 0;
+}
+
+bool resolve_disk(char* fs, struct disk_info* disk) {
+    struct stat fs_stat;
+    char path[sizeof(fs1_id) + 8];
+    uint32_t device[2] = { 0, 0, };
+    bool valid;
+
+    memset(disk, 0, sizeof(struct disk_info));
+    if (fs[0] == 0)
+        return false;
+    if ((valid = !trace_replaying && stat(fs, &fs_stat) == 0)) {
+        device[0] = major(fs_stat.st_dev);
+        device[1] = minor(fs_stat.st_dev);
+    }
+    snprintf(path, sizeof(path), "stat:%s", fs);
+    if (!trace_value(path, device, sizeof(device), valid) || device[0] == 0)
+        return false;
+    disk->major = device[0];
+    disk->minor = device[1];
+    return true;
+}
+
+void update_disk_rates(struct disk_info* disk, struct disk_stats* stats, long long elapsed) {
+    unsigned long ios = (stats->reads - disk->stats.reads) + (stats->writes - disk->stats.writes);
+
+    if (disk->ready && 0 < elapsed) {
+        disk->read_rate = (stats->sectors_read - disk->stats.sectors_read) * 512000.0 / elapsed;
+        disk->write_rate = (stats->sectors_written - disk->stats.sectors_written) * 512000.0 / elapsed;
+        disk->iops = ios * 1000.0 / elapsed;
+        disk->utilization = (stats->io_ticks - disk->stats.io_ticks) * 100.0 / elapsed;
+        if (100 < disk->utilization)
+            disk->utilization = 100;
+        disk->await = ios ? (double)((stats->read_ticks - disk->stats.read_ticks) + (stats->write_ticks - disk->stats.write_ticks)) / ios : 0;
+    }
+    disk->stats = *stats;
+    disk->ready = true;
+}
+
+/* Every monitored filesystem is mapped to its block device by the major and minor     */
+/* numbers of st_dev, then /proc/diskstats is parsed in a single pass for both disks.  */
+int collect_disk_info(void) {
+    static char diskstats_string[DISKSTATS_BUFFER_SIZE];
+    long long current_time = monotonic_time_ms();
+    long long elapsed = current_time - disk_sample_time;
+    struct disk_stats stats;
+    unsigned int major_id, minor_id;
+    char* string_pointer = diskstats_string;
+    char* end_pointer;
+
+    if (read_proc_file(&diskstats_fd, "/proc/diskstats", diskstats_string, sizeof(diskstats_string)) < 0) {
+        write_error("Failed to read /proc/diskstats");
+        return -1;
+    }
+    while (*string_pointer) {
+        major_id = strtoul(string_pointer, &end_pointer, 10);
+        minor_id = strtoul(end_pointer, &end_pointer, 10);
+        if ((fs1_disk.major == major_id && fs1_disk.minor == minor_id) || (fs2_disk.major == major_id && fs2_disk.minor == minor_id)) {
+            end_pointer = skip_text(end_pointer, 2);
+            if (sscanf(end_pointer, "%lu %*u %lu %lu %lu %*u %lu %lu %*u %lu", &stats.reads, &stats.sectors_read, &stats.read_ticks,
+                &stats.writes, &stats.sectors_written, &stats.write_ticks, &stats.io_ticks) == 7) {
+                if (fs1_disk.major == major_id && fs1_disk.minor == minor_id)
+                    update_disk_rates(&fs1_disk, &stats, elapsed);
+                if (fs2_disk.major == major_id && fs2_disk.minor == minor_id)
+                    update_disk_rates(&fs2_disk, &stats, elapsed);
+            }
+        }
+        if ((string_pointer = strchr(end_pointer, '\n')) == NULL)
+            break;
+        string_pointer++;
+    }
+    disk_sample_time = current_time;
+
+    return fs1_disk.ready || fs2_disk.ready ? 0 : -1;
+}
+
+int warm_disk_info(void) {
+    resolve_disk(fs1_id, &fs1_disk);
+    resolve_disk(fs2_id, &fs2_disk);
+    return collect_disk_info();
+}
+
+int collect_psi_info(void) {
+    char psi_string[300];
+    char* full_string;
+    int result = -1;
+
+    for (int i = 0; i < PSI_RESOURCES; i++) {
+        if (read_proc_file(&psi_fds[i], psi_files[i], psi_string, sizeof(psi_string)) < 0 || sscanf(psi_string, "some avg10=%lf", &psi_some[i]) != 1)
+            continue;
+        if ((full_string = strstr(psi_string, "full avg10=")) == NULL || sscanf(full_string, "full avg10=%lf", &psi_full[i]) != 1)
+            psi_full[i] = 0;
+        result = 0;
+    }
+
+    return result;
+}
+
+bool psi_alert(int resource) {
+    return psi_alert_time[resource] != 0 && (monotonic_time_ms() / 1000 - psi_alert_time[resource]) < PSI_ALERT_HOLD;
+}
+
+int collect_proc_info(void) {
+    return scan_processes(true);
+}
+
+int warm_proc_info(void) {
+    return scan_processes(false);
+}
+
+/* Each configured cgroup keeps its files open, a cgroup removed when its service  */
+/* stops fails the read and its files are opened again on the next tick, so the     */
+/* page shows it as missing until the service is back.                             */
+ssize_t read_cgroup_file(struct cgroup_info* cgroup, int file, char* buffer, size_t buffer_size) {
+    char path[sizeof(cgroup->path) + 20];
+
+    snprintf(path, sizeof(path), "%s/%s", cgroup->path, cgroup_files[file]);
+    return read_proc_file(&cgroup->fds[file], path, buffer, buffer_size);
+}
+
+void sample_cgroup(struct cgroup_info* cgroup, long long elapsed) {
+    char buffer[1024];
+    char* string_pointer;
+    unsigned long long usage_usec;
+    unsigned long long throttled_usec = 0;
+    unsigned long long read_bytes = 0;
+    unsigned long long write_bytes = 0;
+    unsigned long long value;
+    bool ready = cgroup->ready;
+
+    if (read_cgroup_file(cgroup, CGROUP_CPU_STAT, buffer, sizeof(buffer)) < 0 || sscanf(buffer, "usage_usec %llu", &usage_usec) != 1) {
+        cgroup->ready = false;
+        return;
+    }
+    if ((string_pointer = strstr(buffer, "throttled_usec ")) != NULL)
+        throttled_usec = strtoull(string_pointer + 15, NULL, 10);
+    cgroup->memory_current = read_cgroup_file(cgroup, CGROUP_MEMORY_CURRENT, buffer, sizeof(buffer)) < 0 ? -1 : strtoll(buffer, NULL, 10);
+    cgroup->memory_max = read_cgroup_file(cgroup, CGROUP_MEMORY_MAX, buffer, sizeof(buffer)) < 0 || !isdigit((unsigned char)buffer[0]) ? -1 : strtoll(buffer, NULL, 10);
+    if (read_cgroup_file(cgroup, CGROUP_IO_STAT, buffer, sizeof(buffer)) >= 0) {
+        for (string_pointer = buffer; (string_pointer = strstr(string_pointer, "bytes=")) != NULL; string_pointer += 6) {
+            value = strtoull(string_pointer + 6, NULL, 10);
+            if (string_pointer[-1] == 'r')
+                read_bytes += value;
+            else if (string_pointer[-1] == 'w')
+                write_bytes += value;
+        }
+    }
+    if (read_cgroup_file(cgroup, CGROUP_CPU_PRESSURE, buffer, sizeof(buffer)) < 0 || sscanf(buffer, "some avg10=%lf", &cgroup->pressure) != 1)
+        cgroup->pressure = 0;
+
+    if (ready && 0 < elapsed) {
+        cgroup->cpu_percent = (usage_usec - cgroup->usage_usec) / (elapsed * 10.0);
+        cgroup->throttled_percent = (throttled_usec - cgroup->throttled_usec) / (elapsed * 10.0);
+        cgroup->read_rate = (read_bytes - cgroup->read_bytes) * 1000.0 / elapsed;
+        cgroup->write_rate = (write_bytes - cgroup->write_bytes) * 1000.0 / elapsed;
+    }
+    else {
+        cgroup->cpu_percent = 0;
+        cgroup->throttled_percent = 0;
+        cgroup->read_rate = 0;
+        cgroup->write_rate = 0;
+    }
+    cgroup->usage_usec = usage_usec;
+    cgroup->throttled_usec = throttled_usec;
+    cgroup->read_bytes = read_bytes;
+    cgroup->write_bytes = write_bytes;
+    cgroup->ready = true;
+}
+
+int collect_cgroup_info(void) {
+    long long current_time = monotonic_time_ms();
+
+    for (unsigned int i = 0; i < cgroups_count; i++)
+        sample_cgroup(&cgroups[i], current_time - cgroup_sample_time);
+    cgroup_sample_time = current_time;
+
+    return 0;
+}
+
+int warm_cgroup_info(void) {
+    for (unsigned int i = 0; i < cgroups_count; i++)
+        cgroups[i].ready = false;
+    cgroup_sample_time = 0;
+    return collect_cgroup_info();
+}
+
+void add_cgroup(char* path) {
+    struct cgroup_info* cgroup;
+    char* name;
+    char* suffix;
+
+    if (MAX_CGROUPS <= cgroups_count) {
+        write_error("Too many cgroups in the config file");
+        return;
+    }
+    cgroup = &cgroups[cgroups_count++];
+    snprintf(cgroup->path, sizeof(cgroup->path), "%s", path);
+    name = (name = strrchr(path, '/')) != NULL ? name + 1 : path;
+    if ((suffix = strrchr(name, '.')) != NULL)
+        *suffix = 0;
+    snprintf(cgroup->name, sizeof(cgroup->name), "%.5s", name);
+    for (int i = 0; i < CGROUP_FILES; i++)
+        cgroup->fds[i] = -1;
+}
+
+void buffer_write_string(uint16_t buffer[][SCREEN_WIDTH], uint16_t x, uint16_t y, char* string_ptr, uint16_t text_color, uint16_t window_color) {
+    while (*string_ptr) {
+        for (uint16_t i = 0; i < FONT_HEIGHT && (y + i) < SCREEN_HEIGHT; i++) {
+            uint16_t char_row = font[(*string_ptr) - 31][i];
+            for (uint16_t j = 0; j < FONT_WIDTH && (x + j) < SCREEN_WIDTH; j++)
+                buffer[y + i][x + j] = (char_row << j) & 0x8000 ? text_color : window_color;
+        }
+        x += FONT_WIDTH;
+        string_ptr++;
+    }
+}
+
+void buffer_write_h_line(uint16_t buffer[][SCREEN_WIDTH], uint16_t x1, uint16_t x2, uint16_t y, uint16_t color) {
+    for (int i = x1; i < x2;i++)
+        buffer[y][i] = color;
+}
+
+void buffer_write_rectangle(uint16_t buffer[][SCREEN_WIDTH], uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
+    buffer_write_h_line(buffer, x + 4, x + w - 4, y, color);
+    buffer_write_h_line(buffer, x + 3, x + w - 3, y + 1, color);
+    buffer_write_h_line(buffer, x + 2, x + w - 2, y + 2, color);
+    buffer_write_h_line(buffer, x + 1, x + w - 1, y + 3, color);
+    for (int j = y + 4; j < y + h - 4; j++)
+        buffer_write_h_line(buffer, x, x + w, j, color);
+    buffer_write_h_line(buffer, x + 1, x + w - 1, y + h - 4, color);
+    buffer_write_h_line(buffer, x + 2, x + w - 2, y + h - 3, color);
+    buffer_write_h_line(buffer, x + 3, x + w - 3, y + h - 2, color);
+    buffer_write_h_line(buffer, x + 4, x + w - 4, y + h - 1, color);
+}
+
+void buffer_write_box(uint16_t buffer[][SCREEN_WIDTH], unsigned int box, uint16_t color) {
+    const struct rect* rect = &layout->boxes[box];
+
+    buffer_write_rectangle(buffer, rect->x, rect->y, rect->w, rect->h, color);
+}
+
+int flush_buffer(uint16_t buffer[][SCREEN_WIDTH]) {
+    static uint16_t rows[SCREEN_WIDTH * 16];
+    uint8_t caset[] = { 0x00, 0x00, (PANEL_WIDTH - 1) >> 8, (PANEL_WIDTH - 1) & 0xff, };
+    uint8_t raset[] = { 0x00, 0x00, (PANEL_HEIGHT - 1) >> 8, (PANEL_HEIGHT - 1) & 0xff, };
+    uint16_t count;
+    int result = 0;
+
+    if (buffer != screen_buffer)
+        memcpy(screen_buffer, buffer, sizeof(screen_buffer));
+    rfb_mark_dirty(0, 0, PANEL_WIDTH, PANEL_HEIGHT);
+    result += lcd_write_window(caset, raset);
+    if (PANEL_WIDTH == SCREEN_WIDTH)
+        return result + spi_write_pixels(&buffer[0][0], SCREEN_WIDTH * PANEL_HEIGHT);
+    /* Narrower rows are packed 16 at a time, every layout width is even so the     */
+    /* 12-bit pixel pairs never straddle two writes.                                 */
+    for (uint16_t row = 0; row < PANEL_HEIGHT; row += count) {
+        count = PANEL_HEIGHT - row < 16 ? PANEL_HEIGHT - row : 16;
+        for (uint16_t i = 0; i < count; i++)
+            memcpy(rows + i * PANEL_WIDTH, buffer[row + i], PANEL_WIDTH * sizeof(uint16_t));
+        result += spi_write_pixels(rows, count * PANEL_WIDTH);
+    }
+
+    return result;
+}
+
+/* A page switch sends only the 16-row bands that differ from what the panel shows, */
+/* the layers of two pages share their title box and most of their frames.          */
+int flush_changed_rows(uint16_t buffer[][SCREEN_WIDTH]) {
+    static uint16_t rows[SCREEN_WIDTH * 16];
+    uint8_t caset[] = { 0x00, 0x00, (PANEL_WIDTH - 1) >> 8, (PANEL_WIDTH - 1) & 0xff, };
+    uint8_t raset[4];
+    uint16_t count;
+    int result = 0;
+
+    for (uint16_t row = 0; row < PANEL_HEIGHT; row += count) {
+        count = PANEL_HEIGHT - row < 16 ? PANEL_HEIGHT - row : 16;
+        for (uint16_t i = 0; i < count; i++)
+            memcpy(rows + i * PANEL_WIDTH, buffer[row + i], PANEL_WIDTH * sizeof(uint16_t));
+        raset[0] = row >> 8;
+        raset[1] = row & 0xff;
+        raset[2] = (row + count - 1) >> 8;
+        raset[3] = (row + count - 1) & 0xff;
+        result += write_rect_to_display(rows, count * PANEL_WIDTH, caset, raset);
+    }
+
+    return result;
+}
+
+/* Log-bucketed histogram with four buckets per power of two, so a quantile is    */
+/* known within an eighth of its value whatever the range, in a fixed table.       */
+unsigned int histogram_bucket(uint32_t value) {
+    unsigned int msb;
+
+    if (value < 4)
+        return value;
+    msb = 31 - __builtin_clz(value);
+    if (HISTOGRAM_BUCKETS <= (msb - 1) * 4)
+        return HISTOGRAM_BUCKETS - 1;
+    return (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+}
+
+uint32_t histogram_value(unsigned int bucket) {
+    unsigned int shift = bucket / 4 - 1;
+
+    if (bucket < 4)
+        return bucket;
+    return ((4 + bucket % 4) << shift) + (1 << shift) / 2;
+}
+
+void histogram_add(struct histogram* histogram, uint32_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->total++;
+}
+
+/* Older samples fade out by halving every count once a window has been counted. */
+void histogram_halve(struct histogram* histogram) {
+    histogram->total = 0;
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->counts[i] /= 2;
+        histogram->total += histogram->counts[i];
+    }
+}
+
+uint32_t histogram_quantile(struct histogram* histogram, double quantile) {
+    uint32_t rank = (uint32_t)(quantile * histogram->total + 0.999999);
+    uint32_t count = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        count += histogram->counts[i];
+        if (rank <= count)
+            return histogram_value(i);
+    }
+    return 0;
+}
+
+bool add_probe(char* name, char* address, unsigned int port) {
+    struct probe_target* probe = &probes[probes_count];
+
+    if (PROBE_TARGETS <= probes_count || 65535 < port || inet_pton(AF_INET, address, &probe->address.sin_addr) != 1)
+        return false;
+    snprintf(probe->name, sizeof(probe->name), "%s", name);
+    probe->address.sin_family = AF_INET;
+    probe->address.sin_port = htons(port);
+    probe->fd = -1;
+    probe->last_rtt = PROBE_LOST;
+    probe->min_rtt = PROBE_LOST;
+    probes_count++;
+    return true;
+}
+
+struct probe_target* find_probe(char* name) {
+    for (unsigned int i = 0; i < probes_count; i++)
+        if (strcmp(probes[i].name, name) == 0)
+            return &probes[i];
+    return NULL;
+}
+
+struct probe_target* find_probe_fd(int fd) {
+    for (unsigned int i = 0; i < probes_count; i++)
+        if (probes[i].fd == fd)
+            return &probes[i];
+    return NULL;
+}
+
+bool probe_tcp(struct probe_target* probe) {
+    return probe->address.sin_port != 0;
+}
+
+double probe_loss(struct probe_target* probe) {
+    uint32_t answered = probe->sent - probe->pending;
+
+    return answered ? probe->lost * 100.0 / answered : 0;
+}
+
+/* The TCP socket only lives for one probe, the ICMP one stays open. */
+void probe_done(struct probe_target* probe, uint32_t rtt) {
+    if (probe_tcp(probe) && 0 <= probe->fd) {
+        poll_unregister(probe->fd);
+        close(probe->fd);
+        probe->fd = -1;
+    }
+    probe->pending = false;
+    probe->last_rtt = rtt;
+    if (rtt == PROBE_LOST)
+        probe->lost++;
+    else {
+        histogram_add(&probe->rtt, rtt);
+        if (rtt < probe->min_rtt)
+            probe->min_rtt = rtt;
+    }
+    probe_version++;
+}
+
+/* Ping sockets get the echo replies matching their identifier from the kernel,   */
+/* without the IP header, only the sequence of the probe in flight is checked.     */
+void probe_icmp_event(int fd, short revents) {
+    struct probe_target* probe = find_probe_fd(fd);
+    struct icmphdr reply;
+    ssize_t length;
+
+    while (0 <= (length = recv(fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_TRUNC))) {
+        if (probe != NULL && probe->pending && (size_t)length >= sizeof(reply) && reply.type == ICMP_ECHOREPLY && ntohs(reply.un.echo.sequence) == probe->sequence)
+            probe_done(probe, monotonic_time_us() - probe->sent_time);
+    }
+}
+
+/* A refused connection still took a round trip to the target. */
+void probe_tcp_event(int fd, short revents) {
+    struct probe_target* probe = find_probe_fd(fd);
+    socklen_t length = sizeof(int);
+    int error = 0;
+
+    if (probe == NULL)
+        return;
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    probe_done(probe, error == 0 || error == ECONNREFUSED ? monotonic_time_us() - probe->sent_time : PROBE_LOST);
+}
+
+void probe_send(struct probe_target* probe) {
+    struct icmphdr echo = { .type = ICMP_ECHO, };
+    int fd;
+
+    if (probe->pending)
+        probe_done(probe, PROBE_LOST);
+    if (PROBE_WINDOW <= probe->sent) {
+        probe->sent /= 2;
+        probe->lost /= 2;
+        histogram_halve(&probe->rtt);
+    }
+    probe->sent++;
+    probe->pending = true;
+    probe->sequence++;
+    probe->sent_time = monotonic_time_us();
+    if (!probe_tcp(probe)) {
+        echo.un.echo.sequence = htons(probe->sequence);
+        if (probe->fd < 0 || sendto(probe->fd, &echo, sizeof(echo), MSG_DONTWAIT, (struct sockaddr*)&probe->address, sizeof(probe->address)) < 0)
+            probe_done(probe, PROBE_LOST);
+        return;
+    }
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        probe_done(probe, PROBE_LOST);
+        return;
+    }
+    probe->fd = fd;
+    if (connect(fd, (struct sockaddr*)&probe->address, sizeof(probe->address)) == 0 || errno == ECONNREFUSED)
+        probe_done(probe, monotonic_time_us() - probe->sent_time);
+    else if (errno != EINPROGRESS || poll_register(fd, POLLOUT, probe_tcp_event) < 0) {
+        close(fd);
+        probe->fd = -1;
+        probe_done(probe, PROBE_LOST);
+    }
+}
+
+/* One probe per target and interval, a probe still unanswered when the next one  */
+/* is due is counted as lost. The replies are timed when the main loop wakes up.   */
+int collect_probe_info(void) {
+    if (!probes_open)
+        return -1;
+    for (unsigned int i = 0; i < probes_count; i++)
+        probe_send(&probes[i]);
+
+    return 0;
+}
+
+void probe_open(void) {
+    int fd;
+
+    for (unsigned int i = 0; i < probes_count; i++) {
+        if (probe_tcp(&probes[i]))
+            continue;
+        if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP)) < 0) {
+            write_error("Failed to open an ICMP probe socket, check net.ipv4.ping_group_range");
+            continue;
+        }
+        if (poll_register(fd, POLLIN, probe_icmp_event) < 0) {
+            close(fd);
+            continue;
+        }
+        probes[i].fd = fd;
+    }
+    probes_open = true;
+}
+
+void probe_close(void) {
+    for (unsigned int i = 0; i < probes_count; i++) {
+        if (0 <= probes[i].fd)
+            close(probes[i].fd);
+        probes[i].fd = -1;
+        probes[i].pending = false;
+    }
+    probes_open = false;
+}
+
+/* The kernel clock discipline as adjtimex reports it, the same call chronyd and    */
+/* ntpd use to steer the clock. Errors are kept in milliseconds, the frequency in   */
+/* ppm. While the screen is on an offset is kept every minute for the clock page,   */
+/* the offsets are kept across activations and only dropped when the clock steps.   */
+int collect_clock_info(void) {
+    struct timex timex = { 0, };
+    time_t current_time = monotonic_time_ms() / 1000;
+    time_t base = wall_time() - current_time;
+    long long values[6];
+    bool valid;
+
+    if ((valid = !trace_replaying && 0 <= (values[0] = adjtimex(&timex)))) {
+        values[1] = timex.status;
+        values[2] = timex.offset;
+        values[3] = timex.esterror;
+        values[4] = timex.maxerror;
+        values[5] = timex.freq;
+    }
+    if (!trace_value("adjtimex", values, sizeof(values), valid))
+        return -1;
+    clock_state = values[0];
+    clock_status = values[1];
+    clock_offset = values[2] / (clock_status & STA_NANO ? 1000000.0 : 1000.0);
+    clock_estimated_error = values[3] / 1000.0;
+    clock_maximum_error = values[4] / 1000.0;
+    clock_frequency = values[5] / 65536.0;
+    if (CLOCK_STEP_LIMIT < base - clock_history_base || base - clock_history_base < -CLOCK_STEP_LIMIT)
+        clock_history_count = 0;
+    clock_history_base = base;
+    if (clock_history_count == 0 || CLOCK_HISTORY_STEP <= current_time - clock_history_time) {
+        memmove(&clock_history[1], &clock_history[0], (CLOCK_HISTORY - 1) * sizeof(double));
+        clock_history[0] = clock_offset;
+        if (clock_history_count < CLOCK_HISTORY)
+            clock_history_count++;
+        clock_history_time = current_time;
+    }
+
+    return 0;
+}
+
+double metric_cpu(void) {
+    return cpu_load * 100 / 4;
+}
+
+double metric_ram(void) {
+    return ram_used;
+}
+
+double metric_temp(void) {
+    return temp_value / 1000.0;
+}
+
+double metric_swap(void) {
+    long swap_total = meminfo.values[MEMINFO_SWAP_TOTAL];
+
+    return swap_total ? (double)(swap_total - meminfo.values[MEMINFO_SWAP_FREE]) * 100 / swap_total : 0;
+}
+
+double metric_swap_io(void) {
+    return swap_in_rate + swap_out_rate;
+}
+
+double metric_fs1(void) {
+    return check_sda ? (double)(fs1_stat.f_blocks - fs1_stat.f_bfree) * 100 / fs1_stat.f_blocks : 0;
+}
+
+double metric_fs2(void) {
+    return check_sdb ? (double)(fs2_stat.f_blocks - fs2_stat.f_bfree) * 100 / fs2_stat.f_blocks : 0;
+}
+
+double metric_fs1_util(void) {
+    return fs1_disk.utilization;
+}
+
+double metric_fs2_util(void) {
+    return fs2_disk.utilization;
+}
+
+double metric_fs1_await(void) {
+    return fs1_disk.await;
+}
+
+double metric_fs2_await(void) {
+    return fs2_disk.await;
+}
+
+double metric_net1_rx(void) {
+    return ifdev1_diff.rx_bytes;
+}
+
+double metric_net1_tx(void) {
+    return ifdev1_diff.tx_bytes;
+}
+
+double metric_net2_rx(void) {
+    return ifdev2_diff.rx_bytes;
+}
+
+double metric_net2_tx(void) {
+    return ifdev2_diff.tx_bytes;
+}
+
+double metric_psi_cpu(void) {
+    return psi_some[PSI_CPU];
+}
+
+double metric_psi_memory(void) {
+    return psi_some[PSI_MEMORY];
+}
+
+double metric_psi_io(void) {
+    return psi_some[PSI_IO];
+}
+
+double metric_tcp_retrans(void) {
+    return tcp_retrans_rate;
+}
+
+double metric_tcp_listen_drops(void) {
+    return tcp_listen_drop_rate;
+}
+
+double metric_tcp_established(void) {
+    return tcp_established;
+}
+
+double metric_tcp_time_wait(void) {
+    return tcp_time_wait;
+}
+
+double metric_tcp_orphan(void) {
+    return tcp_orphan;
+}
+
+double metric_udp_errors(void) {
+    return udp_error_rate;
+}
+
+double metric_net1_signal(void) {
+    return ifdev1_wifi.wireless ? wifi_signal(&ifdev1_wifi) : 0;
+}
+
+double metric_net2_signal(void) {
+    return ifdev2_wifi.wireless ? wifi_signal(&ifdev2_wifi) : 0;
+}
+
+double metric_ctxt(void) {
+    return ctxt_rate;
+}
+
+/* Worst median round trip of the targets in milliseconds. */
+double metric_rtt(void) {
+    double worst = 0;
+
+    for (unsigned int i = 0; i < probes_count; i++)
+        if (probes[i].rtt.total && worst < histogram_quantile(&probes[i].rtt, 0.5) / 1000.0)
+            worst = histogram_quantile(&probes[i].rtt, 0.5) / 1000.0;
+    return worst;
+}
+
+double metric_probe_loss(void) {
+    double worst = 0;
+
+    for (unsigned int i = 0; i < probes_count; i++)
+        if (worst < probe_loss(&probes[i]))
+            worst = probe_loss(&probes[i]);
+    return worst;
+}
+
+double metric_run_delay(void) {
+    double rate = 0;
+
+    for (unsigned int i = 0; i < sched_cpus; i++)
+        if (rate < sched_delay_rates[i])
+            rate = sched_delay_rates[i];
+    return rate;
+}
+
+double metric_slice_wait(void) {
+    double wait = 0;
+
+    for (unsigned int i = 0; i < sched_cpus; i++)
+        if (wait < sched_slice_waits[i])
+            wait = sched_slice_waits[i];
+    return wait;
+}
+
+double metric_daemon_wait(void) {
+    double wait = 0;
+
+    for (unsigned int i = 0; i < daemons_count; i++)
+        if (daemons[i].up && wait < daemons[i].slice_wait)
+            wait = daemons[i].slice_wait;
+    return wait;
+}
+
+double metric_clock_error(void) {
+    return clock_estimated_error;
+}
+
+double metric_clock_offset(void) {
+    return clock_offset < 0 ? -clock_offset : clock_offset;
+}
+
+double metric_net_rx_softirq(void) {
+    double rate = 0;
+
+    for (unsigned int i = 0; i < softirqs_cpus; i++)
+        if (rate < net_rx_core_rates[i])
+            rate = net_rx_core_rates[i];
+    return rate;
+}
+
+struct metric metrics[] = {
+    { "cpu", COLLECTOR_CPU, metric_cpu, },
+    { "ram", COLLECTOR_RAM, metric_ram, },
+    { "temp", COLLECTOR_TEMP, metric_temp, },
+    { "fs1", COLLECTOR_FS, metric_fs1, },
+    { "fs2", COLLECTOR_FS, metric_fs2, },
+    { "fs1_util", COLLECTOR_DISK, metric_fs1_util, },
+    { "fs2_util", COLLECTOR_DISK, metric_fs2_util, },
+    { "fs1_await", COLLECTOR_DISK, metric_fs1_await, },
+    { "fs2_await", COLLECTOR_DISK, metric_fs2_await, },
+    { "net1_rx", COLLECTOR_NET, metric_net1_rx, },
+    { "net1_tx", COLLECTOR_NET, metric_net1_tx, },
+    { "net2_rx", COLLECTOR_NET, metric_net2_rx, },
+    { "net2_tx", COLLECTOR_NET, metric_net2_tx, },
+    { "psi_cpu", COLLECTOR_PSI, metric_psi_cpu, },
+    { "psi_memory", COLLECTOR_PSI, metric_psi_memory, },
+    { "psi_io", COLLECTOR_PSI, metric_psi_io, },
+    { "swap", COLLECTOR_RAM, metric_swap, },
+    { "swap_io", COLLECTOR_RAM, metric_swap_io, },
+    { "tcp_retrans", COLLECTOR_TCP, metric_tcp_retrans, },
+    { "tcp_listen_drops", COLLECTOR_TCP, metric_tcp_listen_drops, },
+    { "tcp_established", COLLECTOR_TCP, metric_tcp_established, },
+    { "tcp_time_wait", COLLECTOR_TCP, metric_tcp_time_wait, },
+    { "tcp_orphan", COLLECTOR_TCP, metric_tcp_orphan, },
+    { "udp_errors", COLLECTOR_TCP, metric_udp_errors, },
+    { "net1_signal", COLLECTOR_WIFI, metric_net1_signal, },
+    { "net2_signal", COLLECTOR_WIFI, metric_net2_signal, },
+    { "ctxt", COLLECTOR_IRQ, metric_ctxt, },
+    { "net_rx_softirq", COLLECTOR_IRQ, metric_net_rx_softirq, },
+    { "rtt", COLLECTOR_PROBE, metric_rtt, },
+    { "probe_loss", COLLECTOR_PROBE, metric_probe_loss, },
+    { "clock_error", COLLECTOR_CLOCK, metric_clock_error, },
+    { "clock_offset", COLLECTOR_CLOCK, metric_clock_offset, },
+    { "run_delay", COLLECTOR_SCHED, metric_run_delay, },
+    { "slice_wait", COLLECTOR_SCHED, metric_slice_wait, },
+    { "daemon_wait", COLLECTOR_SCHED, metric_daemon_wait, },
+};
+
+#define METRICS_COUNT           (sizeof(metrics) / sizeof(metrics[0]))
+
+int find_metric(char* name) {
+    for (size_t i = 0; i < METRICS_COUNT; i++)
+        if (strcmp(metrics[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+bool metric_alert(int metric) {
+    for (unsigned int i = 0; i < alerts_count; i++)
+        if (alerts[i].metric == metric && alerts[i].active)
+            return true;
+    return false;
+}
+
+struct sketch sketches[METRICS_COUNT];
+const char* sketch_windows[SKETCH_WINDOWS] = { "1m", "15m", "awake", };
+
+/* Every sample is coded from the exponent and the three first mantissa bits of its */
+/* absolute value, eight buckets per power of two from 1/16 to 2^28, so a quantile  */
+/* is known within a sixteenth of its value whatever the unit of the metric.        */
+uint16_t sketch_code(double value) {
+    double absolute = value < 0 ? -value : value;
+    uint64_t bits;
+    int code;
+
+    if (!(0.0625 <= absolute))
+        return SKETCH_ZERO;
+    memcpy(&bits, &absolute, sizeof(bits));
+    code = ((int)(bits >> 52) - 1023 + 4) * 8 + (int)((bits >> 49) & 7) + 1;
+    if (SKETCH_ZERO - 1 < code)
+        code = SKETCH_ZERO - 1;
+    return value < 0 ? SKETCH_ZERO - code : SKETCH_ZERO + code;
+}
+
+double sketch_value(uint16_t code) {
+    int magnitude = code < SKETCH_ZERO ? SKETCH_ZERO - code : code - SKETCH_ZERO;
+    uint64_t bits;
+    double value;
+
+    if (magnitude == 0)
+        return 0;
+    magnitude--;
+    bits = (uint64_t)(magnitude / 8 - 4 + 1023) << 52 | (uint64_t)(magnitude % 8) << 49 | (uint64_t)1 << 48;
+    memcpy(&value, &bits, sizeof(value));
+    return code < SKETCH_ZERO ? -value : value;
+}
+
+/* The seconds skipped since the last sample are emptied, so the windows only hold  */
+/* the samples of their time span whatever the collector interval.                  */
+void sketch_add(struct sketch* sketch, double value, time_t current_time) {
+    uint16_t code = sketch_code(value);
+
+    if (SKETCH_SLOTS <= current_time - sketch->last_time)
+        memset(sketch->slots, SKETCH_EMPTY, sizeof(sketch->slots));
+    else
+        for (time_t t = sketch->last_time + 1; t < current_time; t++)
+            sketch->slots[t % SKETCH_SLOTS] = SKETCH_EMPTY;
+    sketch->slots[current_time % SKETCH_SLOTS] = code;
+    sketch->last_time = current_time;
+    sketch->awake[code]++;
+    sketch->awake_total++;
+}
+
+uint32_t sketch_window(struct sketch* sketch, unsigned int window, time_t current_time, uint32_t counts[]) {
+    time_t span = window == SKETCH_MINUTE ? 60 : SKETCH_SLOTS;
+    uint32_t total = 0;
+
+    if (window == SKETCH_AWAKE) {
+        memcpy(counts, sketch->awake, sizeof(sketch->awake));
+        return sketch->awake_total;
+    }
+    memset(counts, 0, SKETCH_BUCKETS * sizeof(uint32_t));
+    for (time_t t = current_time - span + 1; t <= current_time && t <= sketch->last_time; t++) {
+        if (t < 0 || sketch->slots[t % SKETCH_SLOTS] == SKETCH_EMPTY)
+            continue;
+        counts[sketch->slots[t % SKETCH_SLOTS]]++;
+        total++;
+    }
+    return total;
+}
+
+/* The 50th, 95th and 99th percentiles and the maximum of the counted codes. */
+void sketch_quantiles(uint32_t counts[], uint32_t total, double quantiles[4]) {
+    static const double ranks[3] = { 0.5, 0.95, 0.99, };
+    unsigned int next = 0;
+    uint32_t count = 0;
+
+    for (unsigned int i = 0; i < SKETCH_BUCKETS; i++) {
+        if (!counts[i])
+            continue;
+        count += counts[i];
+        while (next < 3 && ranks[next] * total <= count)
+            quantiles[next++] = sketch_value(i);
+        quantiles[3] = sketch_value(i);
+    }
+}
+
+unsigned int sampled_metrics(unsigned int window, time_t current_time, unsigned int sampled[]) {
+    uint32_t counts[SKETCH_BUCKETS];
+    unsigned int count = 0;
+
+    for (size_t i = 0; i < METRICS_COUNT; i++)
+        if (sketch_window(&sketches[i], window, current_time, counts))
+            sampled[count++] = i;
+    return count;
+}
+
+void sample_metrics(uint32_t updated, time_t current_time) {
+    for (size_t i = 0; i < METRICS_COUNT; i++)
+        if (updated & metrics[i].collector)
+            sketch_add(&sketches[i], metrics[i].value(), current_time);
+}
+
+/* The awake window starts over each time the screen is woken up. */
+void reset_awake_sketches(void) {
+    for (size_t i = 0; i < METRICS_COUNT; i++) {
+        memset(sketches[i].awake, 0, sizeof(sketches[i].awake));
+        sketches[i].awake_total = 0;
+    }
+}
+
+/* Written on SIGUSR2 to a temporary file renamed over the previous dump, one line  */
+/* per metric and window with samples.                                               */
+void dump_stats(void) {
+    char temporary_file[sizeof(stats_file) + 4];
+    time_t current_time = monotonic_time_ms() / 1000;
+    uint32_t counts[SKETCH_BUCKETS];
+    double quantiles[4];
+    uint32_t total;
+    FILE* file;
+
+    stats_dump_request = false;
+    snprintf(temporary_file, sizeof(temporary_file), "%s.new", stats_file);
+    if ((file = fopen(temporary_file, "w")) == NULL) {
+        write_error("Failed to write the stats file");
+        return;
+    }
+    fprintf(file, "# %u SPI errors, %u panel faults, %u by status check, %u recoveries, %u failed, last one in %lld ms\n", spi_errors, panel_faults,
+        panel_status_faults, panel_recoveries, panel_recovery_failures, panel_recovery_duration);
+    fprintf(file, "# %lld SPI bytes at %u bits per pixel, %u frames, %lld bytes per frame\n", spi_bytes, color_depth, screen_frames,
+        screen_frames ? spi_bytes / screen_frames : 0);
+    fprintf(file, "# %u live page fields skipped over the frame budget\n", live_skipped_fields);
+    fprintf(file, "# CPU budget %.2f%%, %.2f%% used, level %u of %u\n", cpu_budget, budget_usage, budget_level, BUDGET_LEVELS - 1);
+    fprintf(file, "# %zu metrics, %zu bytes of quantile sketches\n# metric window samples p50 p95 p99 max\n", METRICS_COUNT, sizeof(sketches));
+    for (size_t i = 0; i < METRICS_COUNT; i++) {
+        for (unsigned int window = 0; window < SKETCH_WINDOWS; window++) {
+            if ((total = sketch_window(&sketches[i], window, current_time, counts)) == 0)
+                continue;
+            sketch_quantiles(counts, total, quantiles);
+            fprintf(file, "%s %s %u %.4g %.4g %.4g %.4g\n", metrics[i].name, sketch_windows[window], total, quantiles[0], quantiles[1], quantiles[2], quantiles[3]);
+        }
+    }
+    if (fclose(file) != 0 || rename(temporary_file, stats_file) < 0)
+        write_error("Failed to write the stats file");
+}
+
+uint16_t alert_color(bool alert) {
+    return alert ? alert_color_code : data_text_color_code;
+}
+
+/* Alerts are evaluated on the values just collected, without reading anything else. */
+/* An alert is raised when its metric stays past the threshold for the configured    */
+/* duration, and cleared when it goes back past the clear level, so a value          */
+/* oscillating around the threshold does not raise an alert on every sample.         */
+bool evaluate_alerts(uint32_t updated, time_t current_time) {
+    bool raised = false;
+    char text[EVENT_TEXT_SIZE];
+    double value;
+
+    for (unsigned int i = 0; i < alerts_count; i++) {
+        struct alert* alert = &alerts[i];
+        bool above = alert->clear <= alert->threshold;
+        if (!(updated & metrics[alert->metric].collector))
+            continue;
+        value = metrics[alert->metric].value();
+        if (!alert->active) {
+            if (above ? value < alert->threshold : alert->threshold < value) {
+                alert->since = 0;
+                continue;
+            }
+            if (alert->since == 0)
+                alert->since = current_time;
+            if ((current_time - alert->since) < alert->duration)
+                continue;
+            alert->active = true;
+            raised = true;
+            snprintf(text, sizeof(text), "%s %.4g %c%g", metrics[alert->metric].name, value, above ? '>' : '<', alert->threshold);
+            add_event(true, text);
+        }
+        else if (above ? value <= alert->clear : alert->clear <= value) {
+            alert->active = false;
+            alert->since = 0;
+            snprintf(text, sizeof(text), "%s %.4g ok", metrics[alert->metric].name, value);
+            add_event(false, text);
+        }
+    }
+
+    return raised;
+}
+
+uint8_t cluster_percent(double value) {
+    return value < 0 ? 0 : 100 < value ? 100 : (uint8_t)(value + 0.5);
+}
+
+/* Snapshots are sent in network order into a caller buffer, nothing is allocated:   */
+/* magic, version, length, sequence, name, CPU, RAM, worst file system and disk      */
+/* utilization percents, temperature in tenths of a degree and the receive and       */
+/* transmit rates of the busiest interface. Later versions only append fields and    */
+/* raise the length, so older receivers keep reading the fields they know.           */
+void cluster_encode(uint8_t* out) {
+    struct net_stats* busiest = ifdev1_diff.rx_bytes + ifdev1_diff.tx_bytes < ifdev2_diff.rx_bytes + ifdev2_diff.tx_bytes ? &ifdev2_diff : &ifdev1_diff;
+
+    rfb_put16(out, CLUSTER_MAGIC);
+    out[2] = CLUSTER_VERSION;
+    out[3] = CLUSTER_SNAPSHOT_SIZE;
+    rfb_put32(out + 4, cluster_sequence);
+    memset(out + 8, 0, CLUSTER_NAME_SIZE);
+    memcpy(out + 8, cluster_name, strlen(cluster_name));
+    out[24] = cluster_percent(metric_cpu());
+    out[25] = cluster_percent(metric_ram());
+    out[26] = cluster_percent(metric_fs1() < metric_fs2() ? metric_fs2() : metric_fs1());
+    out[27] = cluster_percent(fs1_disk.utilization < fs2_disk.utilization ? fs2_disk.utilization : fs1_disk.utilization);
+    rfb_put16(out + 28, (uint16_t)(int16_t)(temp_value / 100));
+    rfb_put32(out + 30, 0 < busiest->rx_bytes ? busiest->rx_bytes : 0);
+    rfb_put32(out + 34, 0 < busiest->tx_bytes ? busiest->tx_bytes : 0);
+}
+
+/* Peers are kept by name in a fixed table, a new peer takes the place of the one    */
+/* not heard from for the longest time when the table is full. The severity is the   */
+/* worst of the percents, with the temperature counted against 85 degrees. Any     */
+/* version is accepted, the fields past the size declared by the sender are zero.   */
+bool cluster_decode(uint8_t* in, ssize_t length, time_t current_time) {
+    struct cluster_peer* peer = NULL;
+    char name[CLUSTER_NAME_SIZE + 1];
+    unsigned int severity;
+    uint8_t size;
+
+    if (length < CLUSTER_HEADER_SIZE || rfb_get16(in) != CLUSTER_MAGIC || in[2] == 0 || in[3] < CLUSTER_HEADER_SIZE || length < in[3])
+        return false;
+    size = in[3];
+    memcpy(name, in + 8, CLUSTER_NAME_SIZE);
+    name[CLUSTER_NAME_SIZE] = '\0';
+    for (unsigned int i = 0; i < cluster_peers_count && peer == NULL; i++)
+        if (strcmp(cluster_peers[i].name, name) == 0)
+            peer = &cluster_peers[i];
+    if (peer == NULL && cluster_peers_count < CLUSTER_PEERS)
+        peer = &cluster_peers[cluster_peers_count++];
+    else if (peer == NULL) {
+        peer = &cluster_peers[0];
+        for (unsigned int i = 1; i < cluster_peers_count; i++)
+            if (cluster_peers[i].last_seen < peer->last_seen)
+                peer = &cluster_peers[i];
+    }
+    strcpy(peer->name, name);
+    peer->sequence = rfb_get32(in + 4);
+    peer->last_seen = current_time;
+    peer->cpu = 25 <= size ? in[24] : 0;
+    peer->ram = 26 <= size ? in[25] : 0;
+    peer->fs = 27 <= size ? in[26] : 0;
+    peer->utilization = 28 <= size ? in[27] : 0;
+    peer->temp = 30 <= size ? (int16_t)rfb_get16(in + 28) : 0;
+    peer->rx = 34 <= size ? rfb_get32(in + 30) : 0;
+    peer->tx = 38 <= size ? rfb_get32(in + 34) : 0;
+    severity = peer->cpu;
+    if (severity < peer->ram)
+        severity = peer->ram;
+    if (severity < peer->fs)
+        severity = peer->fs;
+    if (severity < peer->utilization)
+        severity = peer->utilization;
+    if (0 < peer->temp && severity < (unsigned int)peer->temp * 10 / 85)
+        severity = peer->temp * 10 / 85;
+    peer->severity = severity;
+    cluster_version++;
+
+    return true;
+}
+
+void cluster_event(int fd, short revents) {
+    uint8_t buffer[256];
+    ssize_t length;
+
+    while (0 <= (length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)))
+        cluster_decode(buffer, length, monotonic_time_ms() / 1000);
+}
+
+/* Called every tick, sends the snapshot once per interval and drops the peers not   */
+/* heard from for a few intervals. A full socket buffer only loses the snapshot.     */
+void cluster_tick(time_t current_time) {
+    uint8_t snapshot[CLUSTER_SNAPSHOT_SIZE];
+
+    if (cluster_fd < 0)
+        return;
+    for (unsigned int i = 0; i < cluster_peers_count; ) {
+        if ((current_time - cluster_peers[i].last_seen) <= CLUSTER_EXPIRY * cluster_interval) {
+            i++;
+            continue;
+        }
+        cluster_peers[i] = cluster_peers[--cluster_peers_count];
+        cluster_version++;
+    }
+    if ((current_time - cluster_send_time) < cluster_interval)
+        return;
+    cluster_send_time = current_time;
+    cluster_sequence++;
+    cluster_encode(snapshot);
+    sendto(cluster_fd, snapshot, sizeof(snapshot), MSG_DONTWAIT, (struct sockaddr*)&cluster_address, sizeof(cluster_address));
+}
+
+/* Every node sends to the group, the receiving nodes also bind the port and join   */
+/* the group. A unicast address works as well, for a single receiver.             */
+void cluster_open(void) {
+    struct sockaddr_in bind_address = { .sin_family = AF_INET, .sin_port = htons(cluster_port), .sin_addr.s_addr = htonl(INADDR_ANY), };
+    struct ip_mreq membership = { .imr_interface.s_addr = htonl(INADDR_ANY), };
+    int reuse = 1;
+    int fd;
+
+    if (!cluster_group[0])
+        return;
+    cluster_address.sin_family = AF_INET;
+    cluster_address.sin_port = htons(cluster_port);
+    if (inet_pton(AF_INET, cluster_group, &cluster_address.sin_addr) != 1) {
+        write_error("Invalid cluster group address");
+        return;
+    }
+    if (!cluster_name[0] && gethostname(cluster_name, sizeof(cluster_name) - 1) < 0)
+        strcpy(cluster_name, "raspi-mon");
+    if (cluster_interval == 0)
+        cluster_interval = 1;
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        write_error("Failed to open the cluster socket");
+        return;
+    }
+    if (cluster_receive) {
+        membership.imr_multiaddr = cluster_address.sin_addr;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, (struct sockaddr*)&bind_address, sizeof(bind_address)) < 0
+            || (IN_MULTICAST(ntohl(cluster_address.sin_addr.s_addr)) && setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+            || poll_register(fd, POLLIN, cluster_event) < 0) {
+            write_error("Failed to join the cluster group");
+            close(fd);
+            return;
+        }
+    }
+    cluster_fd = fd;
+}
+
+void cluster_close(void) {
+    if (0 <= cluster_fd)
+        close(cluster_fd);
+    cluster_fd = -1;
+}
+
+void compose_background(void) {
+    for (uint16_t i = 0; i < SCREEN_HEIGHT; i++)
+        for (uint16_t j = 0; j < SCREEN_WIDTH; j++)
+            background_buffer[i][j] = background_color_code;
+    background_version++;
+}
+
+void compose_title(uint16_t buffer[][SCREEN_WIDTH], char* title) {
+    buffer_write_box(buffer, LAYOUT_TITLE, window_color_code);
+    buffer_write_string(buffer, PANEL_CENTER_X - (FONT_WIDTH * strlen(title) / 2), NAME_DATA_Y1, title, fixed_text_color_code, window_color_code);
+}
+
+void compose_detail_page(uint16_t buffer[][SCREEN_WIDTH], char* title, char* labels[]) {
+    compose_title(buffer, title);
+    buffer_write_box(buffer, LAYOUT_DETAIL, window_color_code);
+    for (uint8_t i = 0; i < DETAIL_LINES && DETAIL_LINE_Y + (i * DETAIL_LINE_STEP) + FONT_HEIGHT <= PANEL_HEIGHT; i++)
+        if (labels[i] != NULL)
+            buffer_write_string(buffer, DETAIL_LINE_X, DETAIL_LINE_Y + (i * DETAIL_LINE_STEP), labels[i], label_text_color_code, window_color_code);
+}
+
+int display_detail_value(uint8_t line, char* text) {
+    return write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (line * DETAIL_LINE_STEP), text, DETAIL_VALUE_LENGHT, data_text_color_code, window_color_code);
+}
+
+int display_detail_text(uint8_t line, char* text) {
+    return write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y + (line * DETAIL_LINE_STEP), text, DETAIL_LINE_LENGHT, data_text_color_code, window_color_code);
+}
+
+void compose_overview_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char data_string[30];
+
+    for (unsigned int i = LAYOUT_TITLE; i <= LAYOUT_RIGHT; i++)
+        buffer_write_box(buffer, i, window_color_code);
+
+    if (trace_value("hostname", host_name, sizeof(host_name), !trace_replaying && gethostname(host_name, sizeof(host_name)) == 0))
+        buffer_write_string(buffer, PANEL_CENTER_X - (FONT_WIDTH * strlen(host_name) / 2), NAME_DATA_Y1, host_name, fixed_text_color_code, window_color_code);
+    else
+        host_name[0] = 0;
+
+    if (check_ifdev1) {
+        buffer_write_string(buffer, NET1_LABEL_X, NET1_LABEL_Y, ifdev1_id, label_text_color_code, window_color_code);
+        buffer_write_string(buffer, PANEL_CENTER_X - (FONT_WIDTH * strlen(ifdev1_address) / 2), NET1_DATA_Y, ifdev1_address, fixed_text_color_code, window_color_code);
+        buffer_write_string(buffer, NET_LABEL_RX_X, NET1_LABEL_Y, "RX", label_text_color_code, window_color_code);
+        buffer_write_string(buffer, NET_LABEL_TX_X, NET1_LABEL_Y, "TX", label_text_color_code, window_color_code);
+    }
+
+    if (check_ifdev2) {
+        buffer_write_string(buffer, NET2_LABEL_X, NET2_LABEL_Y, ifdev2_id, label_text_color_code, window_color_code);
+        buffer_write_string(buffer, PANEL_CENTER_X - (FONT_WIDTH * strlen(ifdev2_address) / 2), NET2_DATA_Y, ifdev2_address, fixed_text_color_code, window_color_code);
+        buffer_write_string(buffer, NET_LABEL_RX_X, NET2_LABEL_Y, "RX", label_text_color_code, window_color_code);
+        buffer_write_string(buffer, NET_LABEL_TX_X, NET2_LABEL_Y, "TX", label_text_color_code, window_color_code);
+    }
+
+    buffer_write_string(buffer, CPU_LABEL_X1, CPU_DATA_Y1, "CPU", label_text_color_code, window_color_code);
+    buffer_write_string(buffer, RAM_LABEL_X1, RAM_DATA_Y1, "RAM", label_text_color_code, window_color_code);
+    buffer_write_string(buffer, TEMP_LABEL_X1, TEMP_DATA_Y1, "Temp", label_text_color_code, window_color_code);
+    buffer_write_string(buffer, TEMP_FIXED_X1, TEMP_DATA_Y1, "\x1f", data_text_color_code, window_color_code);
+    buffer_write_string(buffer, UPT_LABEL_X1, UPT_DATA_Y1, "UpT", label_text_color_code, window_color_code);
+    buffer_write_string(buffer, FS1_LABEL_X1, FS1_DATA_Y1, "FS1", label_text_color_code, window_color_code);
+    buffer_write_string(buffer, FS2_LABEL_X1, FS2_DATA_Y1, "FS2", label_text_color_code, window_color_code);
+
+    if (check_sda) {
+        format_fs_size(data_string, fs1_stat.f_blocks, fs1_stat.f_frsize);
+        buffer_write_string(buffer, FS1_FIXED_X1, FS1_DATA_Y1, data_string, fixed_text_color_code, window_color_code);
+    }
+    else
+        buffer_write_string(buffer, FS1_FIXED_X1, FS1_DATA_Y1, "N/A", fixed_text_color_code, window_color_code);
+
+    if (check_sdb) {
+        format_fs_size(data_string, fs2_stat.f_blocks, fs2_stat.f_frsize);
+        buffer_write_string(buffer, FS2_FIXED_X1, FS2_DATA_Y1, data_string, fixed_text_color_code, window_color_code);
+    }
+    else
+        buffer_write_string(buffer, FS2_FIXED_X1, FS2_DATA_Y1, "N/A", fixed_text_color_code, window_color_code);
+}
+
+/* The last round trip to the probe named after an interface, on its address line, */
+/* in the alert color when it was lost or the target has the worst alerting median. */
+int display_rtt_info(uint16_t y, char* ifdev, uint16_t window_color) {
+    struct probe_target* probe = find_probe(ifdev);
+    char rtt_string[10];
+    bool alert;
+
+    if (probe == NULL)
+        return 0;
+    alert = probe->last_rtt == PROBE_LOST || (metric_alert(METRIC_RTT) && histogram_quantile(&probe->rtt, 0.5) / 1000.0 == metric_rtt());
+    format_rtt(rtt_string, probe->sent ? probe->last_rtt : 0);
+    return write_text_field(RTT_X, y, rtt_string, PROBE_RTT_LENGHT, alert_color(alert && probe->sent), window_color);
+}
+
+/* The hostname line of the overview alternates with the watched daemons and stays */
+/* on them while one is down. A daemon down is shown in the alert color, one that    */
+/* was restarted is followed by its restart count.                                   */
+int display_daemon_info(bool redraw) {
+    static bool shown = false;
+    static unsigned int displayed_version = 0;
+    uint8_t line_lenght = (layout->boxes[LAYOUT_TITLE].w / FONT_WIDTH) - 2;
+    uint16_t line_x = PANEL_CENTER_X - (FONT_WIDTH * line_lenght / 2);
+    char names[DAEMONS][DAEMON_NAME_SIZE + 16];
+    unsigned int lenght = 0;
+    unsigned int count = 0;
+    bool show = false;
+    int result = 0;
+
+    if (daemons_count == 0)
+        return result;
+    for (unsigned int i = 0; i < daemons_count; i++)
+        show = show || !daemons[i].up;
+    show = show || (monotonic_time_ms() / 1000 / DAEMON_SWAP_TIME) % 2;
+    if (!redraw && show == shown && (!show || displayed_version == daemon_version))
+        return result;
+    shown = show;
+    displayed_version = daemon_version;
+    if (redraw && !show)
+        return result;
+    result += write_text_field(line_x, NAME_DATA_Y1, "", line_lenght, fixed_text_color_code, window_color_code);
+    if (!show)
+        return result + write_text_field(PANEL_CENTER_X - (FONT_WIDTH * strlen(host_name) / 2), NAME_DATA_Y1, host_name, strlen(host_name), fixed_text_color_code, window_color_code);
+    for (; count < daemons_count; count++) {
+        if (daemons[count].restarts)
+            snprintf(names[count], sizeof(names[count]), "%s(%u)", daemons[count].name, daemons[count].restarts);
+        else
+            snprintf(names[count], sizeof(names[count]), "%s", daemons[count].name);
+        if (line_lenght < lenght + (0 < count) + strlen(names[count]))
+            break;
+        lenght += (0 < count) + strlen(names[count]);
+    }
+    line_x = PANEL_CENTER_X - (FONT_WIDTH * lenght / 2);
+    for (unsigned int i = 0; i < count; i++) {
+        result += write_text_field(line_x, NAME_DATA_Y1, names[i], strlen(names[i]), alert_color(!daemons[i].up), window_color_code);
+        line_x += FONT_WIDTH * (strlen(names[i]) + 1);
+    }
+
+    return result;
+}
+
+int update_overview_page(uint32_t updated) {
+    static unsigned int displayed_version = 0;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    result += display_daemon_info(updated & PAGE_REDRAW);
+    if (updated & COLLECTOR_NET)
+        result += display_net_info(alert_color(metric_alert(METRIC_NET1_RX)), alert_color(metric_alert(METRIC_NET1_TX)),
+            alert_color(metric_alert(METRIC_NET2_RX)), alert_color(metric_alert(METRIC_NET2_TX)), window_color_code);
+    if (updated & COLLECTOR_WIFI) {
+        if (check_ifdev1)
+            result += display_signal_info(NET1_LABEL_Y, &ifdev1_wifi, metric_alert(METRIC_NET1_SIGNAL), window_color_code);
+        if (check_ifdev2)
+            result += display_signal_info(NET2_LABEL_Y, &ifdev2_wifi, metric_alert(METRIC_NET2_SIGNAL), window_color_code);
+    }
+    if ((updated & PAGE_REDRAW) || displayed_version != probe_version) {
+        displayed_version = probe_version;
+        if (check_ifdev1)
+            result += display_rtt_info(NET1_DATA_Y, ifdev1_id, window_color_code);
+        if (check_ifdev2)
+            result += display_rtt_info(NET2_DATA_Y, ifdev2_id, window_color_code);
+    }
+    if (updated & COLLECTOR_CPU)
+        result += display_cpu_info(alert_color(psi_alert(PSI_CPU) || metric_alert(METRIC_CPU) || metric_alert(METRIC_PSI_CPU)), window_color_code);
+    if (updated & COLLECTOR_RAM)
+        result += display_ram_info(alert_color(psi_alert(PSI_MEMORY) || metric_alert(METRIC_RAM) || metric_alert(METRIC_PSI_MEMORY) || metric_alert(METRIC_SWAP) || metric_alert(METRIC_SWAP_IO)), window_color_code);
+    if (updated & COLLECTOR_TEMP)
+        result += display_temp_info(alert_color(metric_alert(METRIC_TEMP)), window_color_code);
+    if (updated & COLLECTOR_UPTIME)
+        result += display_uptime_info(data_text_color_code, window_color_code);
+    if (updated & COLLECTOR_FS) {
+        if (check_sda)
+            result += display_fs1_info(alert_color(metric_alert(METRIC_FS1)), window_color_code);
+        if (check_sdb)
+            result += display_fs2_info(alert_color(metric_alert(METRIC_FS2)), window_color_code);
+    }
+    if (updated & COLLECTOR_DISK) {
+        bool io_alert = psi_alert(PSI_IO) || metric_alert(METRIC_PSI_IO);
+        if (check_sda)
+            result += display_fs_io_info(&fs1_disk, &fs1_stat, FS1_DATA_Y1, alert_color(io_alert || metric_alert(METRIC_FS1_UTIL) || metric_alert(METRIC_FS1_AWAIT)), fixed_text_color_code, window_color_code);
+        if (check_sdb)
+            result += display_fs_io_info(&fs2_disk, &fs2_stat, FS2_DATA_Y1, alert_color(io_alert || metric_alert(METRIC_FS2_UTIL) || metric_alert(METRIC_FS2_AWAIT)), fixed_text_color_code, window_color_code);
+    }
+
+    return result;
+}
+
+void compose_network_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { NULL, };
+
+    if (check_ifdev1) {
+        labels[0] = ifdev1_id;
+        labels[1] = "RX";
+        labels[2] = "TX";
+    }
+    if (check_ifdev2) {
+        labels[3] = ifdev2_id;
+        labels[4] = "RX";
+        labels[5] = "TX";
+    }
+    labels[6] = "TCP";
+    labels[7] = "Drops";
+    compose_detail_page(buffer, "Network", labels);
+}
+
+int display_net_detail(uint8_t line, long bytes, long packets, long errs, long drop) {
+    char rate_string[20];
+    char data_string[40];
+
+    format_rate(rate_string, bytes);
+    sprintf(data_string, "%s/s %4ldp %2lde %2ldd", rate_string, packets, errs, drop);
+    return display_detail_value(line, data_string);
+}
+
+/* Wireless interfaces show the link in place of the address, which is still shown  */
+/* on the overview: signal and noise, tx bitrate, link quality, and the retries and */
+/* failed transmissions since the previous update.                                   */
+int display_wifi_detail(uint8_t line, struct wifi_info* wifi, bool alert) {
+    char noise_string[8] = "";
+    char data_string[60];
+
+    if (-256 < wifi->noise && wifi->noise < 0)
+        snprintf(noise_string, sizeof(noise_string), "/%.0f", wifi->noise);
+    if (wifi->station)
+        snprintf(data_string, sizeof(data_string), "%d%sdBm %uM Q%.0f R%u F%u", wifi->signal, noise_string, wifi->bitrate / 10, wifi->link, wifi->tx_retries_diff, wifi->tx_failed_diff);
+    else
+        snprintf(data_string, sizeof(data_string), "%.0f%sdBm Q%.0f R%lu", wifi->level, noise_string, wifi->link, wifi->retry);
+    return write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (line * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, alert_color(alert || signal_bars(wifi) <= 1), window_color_code);
+}
+
+int update_network_page(uint32_t updated) {
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (check_ifdev1) {
+        if (ifdev1_wifi.wireless)
+            result += (updated & COLLECTOR_WIFI) ? display_wifi_detail(0, &ifdev1_wifi, metric_alert(METRIC_NET1_SIGNAL)) : 0;
+        else
+            result += display_detail_value(0, ifdev1_address);
+        if (updated & COLLECTOR_NET) {
+            result += display_net_detail(1, ifdev1_diff.rx_bytes, ifdev1_diff.rx_packets, ifdev1_diff.rx_errs, ifdev1_diff.rx_drop);
+            result += display_net_detail(2, ifdev1_diff.tx_bytes, ifdev1_diff.tx_packets, ifdev1_diff.tx_errs, ifdev1_diff.tx_drop);
+        }
+    }
+    if (check_ifdev2) {
+        if (ifdev2_wifi.wireless)
+            result += (updated & COLLECTOR_WIFI) ? display_wifi_detail(3, &ifdev2_wifi, metric_alert(METRIC_NET2_SIGNAL)) : 0;
+        else
+            result += display_detail_value(3, ifdev2_address);
+        if (updated & COLLECTOR_NET) {
+            result += display_net_detail(4, ifdev2_diff.rx_bytes, ifdev2_diff.rx_packets, ifdev2_diff.rx_errs, ifdev2_diff.rx_drop);
+            result += display_net_detail(5, ifdev2_diff.tx_bytes, ifdev2_diff.tx_packets, ifdev2_diff.tx_errs, ifdev2_diff.tx_drop);
+        }
+    }
+    if (updated & COLLECTOR_TCP) {
+        sprintf(data_string, "%4ldE %4ldTW %3ldO", tcp_established, tcp_time_wait, tcp_orphan);
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (6 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            alert_color(metric_alert(METRIC_TCP_ESTABLISHED) || metric_alert(METRIC_TCP_TIME_WAIT) || metric_alert(METRIC_TCP_ORPHAN)), window_color_code);
+        sprintf(data_string, "R%3.0f %3.0f%% L%2.0f/%-2.0f U%2.0f", tcp_retrans_rate, tcp_retrans_percent, tcp_listen_overflow_rate, tcp_listen_drop_rate, udp_error_rate);
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (7 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            alert_color(metric_alert(METRIC_TCP_RETRANS) || metric_alert(METRIC_TCP_LISTEN_DROPS) || metric_alert(METRIC_UDP_ERRORS)), window_color_code);
+    }
+
+    return result;
+}
+
+void compose_disks_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "FS1", "Free", "R/W", "IO", "FS2", "Free", "R/W", "IO", };
+
+    compose_detail_page(buffer, "Disks", labels);
+}
+
+int display_fs_detail(uint8_t line, char* fs, bool ready, struct statvfs* stat) {
+    char size_string[20];
+    char data_string[60];
+    int result = 0;
+
+    if (!ready) {
+        sprintf(data_string, "%-13.13s N/A", fs);
+        result += display_detail_value(line, data_string);
+        result += display_detail_value(line + 1, "");
+        return result;
+    }
+    format_fs_size(size_string, stat->f_blocks, stat->f_frsize);
+    sprintf(data_string, "%-8.8s %6s %3d%%", fs, size_string, (int)((stat->f_blocks - stat->f_bfree) * 100 / stat->f_blocks));
+    result += display_detail_value(line, data_string);
+    format_fs_size(size_string, stat->f_bavail, stat->f_frsize);
+    sprintf(data_string, "%6s inodes %3d%%", size_string, stat->f_files ? (int)((stat->f_files - stat->f_ffree) * 100 / stat->f_files) : 0);
+    result += display_detail_value(line + 1, data_string);
+    return result;
+}
+
+int display_disk_detail(uint8_t line, struct disk_info* disk) {
+    char data_string[60];
+    int result = 0;
+
+    if (!disk->ready) {
+        result += display_detail_value(line, "N/A");
+        result += display_detail_value(line + 1, "");
+        return result;
+    }
+    sprintf(data_string, "%5.1f/%5.1f MB/s", disk->read_rate / (1024 * 1024), disk->write_rate / (1024 * 1024));
+    result += display_detail_value(line, data_string);
+    sprintf(data_string, "%4.0fops %3.0f%% %4.0fms", disk->iops, disk->utilization, disk->await);
+    result += display_detail_value(line + 1, data_string);
+    return result;
+}
+
+int update_disks_page(uint32_t updated) {
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & COLLECTOR_FS) {
+        result += display_fs_detail(0, fs1_id, check_sda, &fs1_stat);
+        result += display_fs_detail(4, fs2_id, check_sdb, &fs2_stat);
+    }
+    if (updated & COLLECTOR_DISK) {
+        result += display_disk_detail(2, &fs1_disk);
+        result += display_disk_detail(6, &fs2_disk);
+    }
+
+    return result;
+}
+
+void compose_processes_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Procs", NULL, };
+
+    compose_detail_page(buffer, "Processes", labels);
+}
+
+int update_processes_page(uint32_t updated) {
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & COLLECTOR_PROC) {
+        sprintf(data_string, "%4u run %3u blk %3u", processes_total, processes_running, processes_blocked);
+        result += display_detail_value(0, data_string);
+        for (unsigned int i = 0; i < TOP_PROCESSES; i++) {
+            if (i < top_processes_count)
+                sprintf(data_string, "%5d %-13.13s %5.1f%%", (int)top_processes[i].pid, top_processes[i].name, top_processes[i].ticks * 100.0 / clock_ticks);
+            else
+                data_string[0] = 0;
+            result += display_detail_text(i + 1, data_string);
+        }
+    }
+
+    return result;
+}
+
+void compose_thermal_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Now", "Past", "MHz", "Max", NULL, };
+
+    compose_detail_page(buffer, "Thermal", labels);
+}
+
+void format_throttle_flags(char* data_string, unsigned int flags) {
+    data_string[0] = 0;
+    if (flags & THROTTLE_UNDERVOLTAGE)
+        strcat(data_string, "UV ");
+    if (flags & THROTTLE_FREQ_CAPPED)
+        strcat(data_string, "CAP ");
+    if (flags & THROTTLE_THROTTLED)
+        strcat(data_string, "THR ");
+    if (flags & THROTTLE_SOFT_LIMIT)
+        strcat(data_string, "SOFT");
+    if (data_string[0] == 0)
+        strcpy(data_string, "none");
+}
+
+int update_thermal_page(uint32_t updated) {
+    char data_string[40];
+    char* string_pointer;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & COLLECTOR_TEMP) {
+        format_throttle_flags(data_string, throttled_flags & 0x0f);
+        if (freq_capped && !(throttled_flags & THROTTLE_FREQ_CAPPED))
+            strcat(data_string, " cpufreq");
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y, data_string, DETAIL_VALUE_LENGHT, throttle_indicator() != ' ' ? alert_color_code : data_text_color_code, window_color_code);
+        if (throttled_flags_ready)
+            format_throttle_flags(data_string, (throttled_flags >> 16) & 0x0f);
+        else
+            strcpy(data_string, "N/A");
+        result += display_detail_value(1, data_string);
+        for (unsigned int i = 0; i < DETAIL_LINES - 4; i++) {
+            if (i < thermal_sensors_count)
+                sprintf(data_string, "%-18.18s %6.1f\x1f", thermal_sensors[i].name, thermal_sensors[i].value / 1000.0);
+            else
+                data_string[0] = 0;
+            result += display_detail_text(i + 4, data_string);
+        }
+    }
+    if (updated & COLLECTOR_FREQ) {
+        string_pointer = data_string;
+        for (unsigned int i = 0; i < cpu_freqs_count && i < 4; i++)
+            string_pointer += sprintf(string_pointer, "%4ld ", cpu_freqs[i].cur / 1000);
+        *string_pointer = 0;
+        result += display_detail_value(2, data_string);
+        string_pointer = data_string;
+        for (unsigned int i = 0; i < cpu_freqs_count && i < 4; i++)
+            string_pointer += sprintf(string_pointer, "%4ld ", cpu_freqs[i].max / 1000);
+        *string_pointer = 0;
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (3 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, freq_capped ? alert_color_code : data_text_color_code, window_color_code);
+    }
+
+    return result;
+}
+
+void compose_pressure_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "avg10", "CPU", "Mem", "IO", "Trig", "Wait", "Slice", NULL, };
+
+    compose_detail_page(buffer, "Pressure", labels);
+}
+
+/* The milliseconds per second each core had runnable tasks waiting for it and their */
+/* average wait per timeslice in microseconds, then the watched daemon waiting the   */
+/* longest per timeslice.                                                            */
+int display_sched_info(void) {
+    struct daemon* worst = NULL;
+    char count_string[10];
+    char data_string[40];
+    char* string_pointer;
+    int result = 0;
+
+    if (sched_cpus == 0)
+        return result + display_detail_value(5, "N/A");
+    string_pointer = data_string;
+    for (unsigned int i = 0; i < sched_cpus && i < 4; i++) {
+        format_count(count_string, sched_delay_rates[i]);
+        string_pointer += sprintf(string_pointer, "%s ", count_string);
+    }
+    *string_pointer = 0;
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (5 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, alert_color(metric_alert(METRIC_RUN_DELAY)), window_color_code);
+    string_pointer = data_string;
+    for (unsigned int i = 0; i < sched_cpus && i < 4; i++) {
+        format_count(count_string, sched_slice_waits[i]);
+        string_pointer += sprintf(string_pointer, "%s ", count_string);
+    }
+    *string_pointer = 0;
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (6 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, alert_color(metric_alert(METRIC_SLICE_WAIT)), window_color_code);
+    for (unsigned int i = 0; i < daemons_count; i++)
+        if (daemons[i].up && (worst == NULL || worst->slice_wait < daemons[i].slice_wait))
+            worst = &daemons[i];
+    data_string[0] = 0;
+    if (worst != NULL) {
+        format_count(count_string, worst->slice_wait);
+        sprintf(data_string, "%-15.15s %s us", worst->name, count_string);
+    }
+    result += write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y + (7 * DETAIL_LINE_STEP), data_string, DETAIL_LINE_LENGHT, alert_color(metric_alert(METRIC_DAEMON_WAIT)), window_color_code);
+
+    return result;
+}
+
+int update_pressure_page(uint32_t updated) {
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & COLLECTOR_PSI) {
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y, "   some     full", DETAIL_VALUE_LENGHT, label_text_color_code, window_color_code);
+        for (int i = 0; i < PSI_RESOURCES; i++) {
+            sprintf(data_string, "%6.2f%%  %6.2f%%", psi_some[i], psi_full[i]);
+            result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + ((i + 1) * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, psi_alert(i) ? alert_color_code : data_text_color_code, window_color_code);
+        }
+        sprintf(data_string, "cpu %u mem %u io %u", psi_events[PSI_CPU], psi_events[PSI_MEMORY], psi_events[PSI_IO]);
+        result += display_detail_value(4, data_string);
+    }
+    if (updated & COLLECTOR_SCHED)
+        result += display_sched_info();
+
+    return result;
+}
+
+void compose_events_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { NULL, };
+
+    compose_detail_page(buffer, "Events", labels);
+}
+
+int update_events_page(uint32_t updated) {
+    static unsigned int displayed_version = 0;
+    struct tm local_time;
+    char time_string[20];
+    char data_string[EVENT_TEXT_SIZE + 10];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & PAGE_REDRAW) && displayed_version == events_version)
+        return result;
+    displayed_version = events_version;
+    for (unsigned int i = 0; i < DETAIL_LINES; i++) {
+        if (i < events_count && i < EVENTS_SIZE) {
+            struct event* event = &events[(events_count - 1 - i) % EVENTS_SIZE];
+            localtime_r(&event->time, &local_time);
+            /* The seconds are left out when they would push the end of the text out. */
+            strftime(time_string, sizeof(time_string), DETAIL_LINE_LENGHT < 9 + strlen(event->text) ? "%R" : "%T", &local_time);
+            snprintf(data_string, sizeof(data_string), "%s %s", time_string, event->text);
+            result += write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y + (i * DETAIL_LINE_STEP), data_string, DETAIL_LINE_LENGHT, alert_color(event->raised), window_color_code);
+        }
+        else if (i == 0)
+            result += display_detail_text(i, "No events");
+    }
+
+    return result;
+}
+
+void compose_memory_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Used", "Avail", "Cache", "Swap", "SwpIO", "Dirty", "WrBk", NULL, };
+
+    compose_detail_page(buffer, "Memory", labels);
+}
+
+int display_memory_detail(uint8_t line, long value, long total, uint16_t text_color) {
+    char size_string[20];
+    char data_string[40];
+
+    format_fs_size(size_string, value, 1024);
+    if (total)
+        sprintf(data_string, "%7s %5.1f%%", size_string, value * 100.0 / total);
+    else
+        sprintf(data_string, "%7s", size_string);
+    return write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (line * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, text_color, window_color_code);
+}
+
+int update_memory_page(uint32_t updated) {
+    long total = meminfo.values[MEMINFO_TOTAL];
+    long swap_total = meminfo.values[MEMINFO_SWAP_TOTAL];
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & COLLECTOR_RAM))
+        return result;
+    result += display_memory_detail(0, total - meminfo.values[MEMINFO_AVAILABLE], total, alert_color(metric_alert(METRIC_RAM)));
+    result += display_memory_detail(1, meminfo.values[MEMINFO_AVAILABLE], total, data_text_color_code);
+    result += display_memory_detail(2, meminfo.values[MEMINFO_CACHED], total, data_text_color_code);
+    if (swap_total)
+        result += display_memory_detail(3, swap_total - meminfo.values[MEMINFO_SWAP_FREE], swap_total, alert_color(metric_alert(METRIC_SWAP)));
+    else
+        result += display_detail_value(3, "N/A");
+    sprintf(data_string, "in %4.0f/s out %4.0f/s", swap_in_rate, swap_out_rate);
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (4 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT, alert_color(0 < swap_in_rate + swap_out_rate), window_color_code);
+    result += display_memory_detail(5, meminfo.values[MEMINFO_DIRTY], 0, data_text_color_code);
+    result += display_memory_detail(6, meminfo.values[MEMINFO_WRITEBACK], 0, data_text_color_code);
+
+    return result;
+}
+
+void compose_live_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "CPU", NULL, NULL, NULL, NULL, NULL, NULL, "Frame", };
+
+    if (check_ifdev1) {
+        labels[1] = ifdev1_id;
+        labels[2] = "RX";
+        labels[3] = "TX";
+    }
+    if (check_ifdev2) {
+        labels[4] = ifdev2_id;
+        labels[5] = "RX";
+        labels[6] = "TX";
+    }
+    compose_detail_page(buffer, "Live", labels);
+}
+
+/* The live page samples its own counters, the overview CPU field is the load average */
+/* which can't follow changes faster than a second.                                  */
+int live_sample(void) {
+    char stat_string[256];
+    char net_data_string[4096];
+    struct net_stats stats;
+    long long cpu[8] = { 0, };
+    char* string_pointer = net_data_string;
+    char* line;
+
+    if (read_proc_file(&live_stat_fd, "/proc/stat", stat_string, sizeof(stat_string)) < 0 ||
+        sscanf(stat_string, "cpu %lld %lld %lld %lld %lld %lld %lld %lld", &cpu[0], &cpu[1], &cpu[2], &cpu[3], &cpu[4], &cpu[5], &cpu[6], &cpu[7]) < 4)
+        return -1;
+    live_cpu_total = cpu[0] + cpu[1] + cpu[2] + cpu[3] + cpu[4] + cpu[5] + cpu[6] + cpu[7];
+    live_values[LIVE_CPU] = live_cpu_total - cpu[3] - cpu[4];
+    if (read_proc_file(&live_net_fd, "/proc/net/dev", net_data_string, sizeof(net_data_string)) < 0)
+        return -1;
+    while ((line = next_line(&string_pointer)) != NULL) {
+        if (check_ifdev1 && parse_net_stats(line, ifdev1_id, &stats)) {
+            live_values[LIVE_NET1_RX] = stats.rx_bytes;
+            live_values[LIVE_NET1_TX] = stats.tx_bytes;
+        }
+        else if (check_ifdev2 && parse_net_stats(line, ifdev2_id, &stats)) {
+            live_values[LIVE_NET2_RX] = stats.rx_bytes;
+            live_values[LIVE_NET2_TX] = stats.tx_bytes;
+        }
+    }
+
+    return 0;
+}
+
+bool live_field_enabled(unsigned int field) {
+    if (field == LIVE_NET1_RX || field == LIVE_NET1_TX)
+        return check_ifdev1;
+    if (field == LIVE_NET2_RX || field == LIVE_NET2_TX)
+        return check_ifdev2;
+    return true;
+}
+
+void live_reset(long long current_time) {
+    for (unsigned int i = 0; i < LIVE_FIELDS; i++) {
+        live_fields[i].value = live_values[i];
+        live_fields[i].total = live_cpu_total;
+        live_fields[i].time = current_time;
+        live_fields[i].text[0] = 0;
+    }
+}
+
+/* Draws the fields round robin until the SPI time of the frame reaches the budget,  */
+/* a dropped field keeps its previous sample so the next frame it gets covers the    */
+/* whole interval. Fields are only sent when their text changed. Returns the SPI     */
+/* time in microseconds.                                                              */
+long long live_draw(long long current_time, long long budget) {
+    static const uint8_t lines[LIVE_FIELDS] = { 0, 2, 3, 5, 6, };
+    char rate_string[20];
+    char text[40];
+    struct live_field* field;
+    bool first_dropped = true;
+    long long spent = 0;
+    long long start;
+    unsigned int next = live_next_field;
+
+    for (unsigned int n = 0; n < LIVE_FIELDS; n++) {
+        unsigned int i = (live_next_field + n) % LIVE_FIELDS;
+        field = &live_fields[i];
+        if (!live_field_enabled(i) || current_time <= field->time)
+            continue;
+        if (budget && budget <= spent) {
+            if (first_dropped)
+                next = i;
+            first_dropped = false;
+            live_skipped_fields++;
+            continue;
+        }
+        if (i == LIVE_CPU) {
+            if (live_cpu_total <= field->total)
+                continue;
+            sprintf(text, "%5.1f%%", (live_values[i] - field->value) * 100.0 / (live_cpu_total - field->total));
+        }
+        else {
+            format_rate(rate_string, (live_values[i] - field->value) * 1000 / (current_time - field->time));
+            sprintf(text, "%s/s", rate_string);
+        }
+        field->value = live_values[i];
+        field->total = live_cpu_total;
+        field->time = current_time;
+        if (strcmp(text, field->text) == 0)
+            continue;
+        strcpy(field->text, text);
+        start = monotonic_time_us();
+        write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (lines[i] * DETAIL_LINE_STEP), text, LIVE_VALUE_LENGHT, data_text_color_code, window_color_code);
+        spent += monotonic_time_us() - start;
+    }
+    live_next_field = next;
+
+    return spent;
+}
+
+/* Frames are scheduled on a fixed period, when the loop falls behind the missed     */
+/* frames are skipped instead of drawn late. After the timeout the page goes back to  */
+/* the 1 Hz tick.                                                                     */
+unsigned int live_frame_rate(void) {
+    return budget_level && BUDGET_LIVE_RATE < live_rate ? BUDGET_LIVE_RATE : live_rate;
+}
+
+void live_frame(long long current_time) {
+    long long period = 1000 / live_frame_rate();
+
+    trace_event(TRACE_FRAME, 0);
+    if (live_until <= current_time) {
+        live_active = false;
+        return;
+    }
+    if (live_sample() == 0) {
+        live_spi_time += live_draw(current_time, (long long)live_frame_budget * 1000);
+        live_frames++;
+        screen_frames++;
+    }
+    next_frame_time += period;
+    if (next_frame_time <= current_time) {
+        live_dropped_frames += (current_time - next_frame_time) / period + 1;
+        next_frame_time = current_time + period;
+    }
+}
+
+int update_live_page(uint32_t updated) {
+    long long current_time = monotonic_time_ms();
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & PAGE_REDRAW) {
+        if (check_ifdev1)
+            result += display_detail_value(1, ifdev1_address);
+        if (check_ifdev2)
+            result += display_detail_value(4, ifdev2_address);
+        live_sample();
+        live_reset(current_time);
+        live_active = 1 < live_frame_rate();
+        live_until = current_time + (long long)live_timeout * 1000;
+        next_frame_time = current_time + 1000 / (live_frame_rate() ? live_frame_rate() : 1);
+        live_frames = 0;
+        live_dropped_frames = 0;
+        live_spi_time = 0;
+        return result;
+    }
+    if (live_active) {
+        sprintf(data_string, "%2uHz %4.1fms %3u drop", live_frames, live_frames ? live_spi_time / 1000.0 / live_frames : 0.0, live_dropped_frames);
+        live_frames = 0;
+        live_dropped_frames = 0;
+        live_spi_time = 0;
+    }
+    else {
+        if (live_sample() == 0)
+            live_draw(current_time, 0);
+        strcpy(data_string, " 1Hz");
+    }
+    result += display_detail_value(7, data_string);
+
+    return result;
+}
+
+void compose_services_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { NULL, };
+
+    for (unsigned int i = 0; i < cgroups_count; i++)
+        labels[i * 2] = cgroups[i].name;
+    compose_detail_page(buffer, "Services", labels);
+}
+
+/* Two lines per service, CPU percent of one core and memory against its limit, then */
+/* read and write rates, throttled time percent and CPU pressure.                    */
+int update_services_page(uint32_t updated) {
+    char size_string[2][20];
+    char data_string[40];
+    struct cgroup_info* cgroup;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & COLLECTOR_CGROUP))
+        return result;
+    if (cgroups_count == 0)
+        result += display_detail_text(0, "No cgroups configured");
+    for (unsigned int i = 0; i < cgroups_count; i++) {
+        cgroup = &cgroups[i];
+        if (!cgroup->ready) {
+            result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (i * 2 * DETAIL_LINE_STEP), "not found", DETAIL_VALUE_LENGHT, alert_color_code, window_color_code);
+            result += display_detail_value(i * 2 + 1, "");
+            continue;
+        }
+        if (cgroup->memory_current < 0)
+            strcpy(size_string[0], "-");
+        else
+            format_fs_size(size_string[0], cgroup->memory_current / 1024, 1024);
+        if (0 <= cgroup->memory_current && 0 <= cgroup->memory_max) {
+            format_fs_size(size_string[1], cgroup->memory_max / 1024, 1024);
+            sprintf(data_string, "%5.1f%% %s/%s", cgroup->cpu_percent, size_string[0], size_string[1]);
+        }
+        else
+            sprintf(data_string, "%5.1f%% %s", cgroup->cpu_percent, size_string[0]);
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (i * 2 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            0 <= cgroup->memory_max && cgroup->memory_max * 0.9 < cgroup->memory_current ? alert_color_code : data_text_color_code, window_color_code);
+        format_rate(size_string[0], cgroup->read_rate);
+        format_rate(size_string[1], cgroup->write_rate);
+        sprintf(data_string, "R%s W%s T%2.0f P%2.0f", size_string[0], size_string[1], cgroup->throttled_percent, cgroup->pressure);
+        result += display_detail_value(i * 2 + 1, data_string);
+    }
+
+    return result;
+}
+
+void compose_cluster_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Host  CPU RAM Tmp Dsk  Net", NULL, };
+
+    compose_detail_page(buffer, "Cluster", labels);
+}
+
+/* Peers are often named with a shared prefix, like rpi-node1 to rpi-node12, when a */
+/* name does not fit in its column the prefix common to all the peers is left out.  */
+size_t cluster_name_prefix(void) {
+    size_t prefix = strlen(cluster_peers[0].name);
+    size_t longest = 0;
+
+    if (cluster_peers_count < 2)
+        return 0;
+    for (unsigned int i = 0; i < cluster_peers_count; i++) {
+        while (prefix && strncmp(cluster_peers[i].name, cluster_peers[0].name, prefix) != 0)
+            prefix--;
+        if (prefix && prefix == strlen(cluster_peers[i].name))
+            prefix--;
+        longest = longest < strlen(cluster_peers[i].name) ? strlen(cluster_peers[i].name) : longest;
+    }
+    return CLUSTER_NAME_LENGHT < longest ? prefix : 0;
+}
+
+/* One row per peer, the worst first: CPU, RAM, temperature, file system usage and */
+/* the receive plus transmit rate of its busiest interface.                        */
+int update_cluster_page(uint32_t updated) {
+    static unsigned int displayed_version = 0;
+    struct cluster_peer* order[CLUSTER_PEERS];
+    struct cluster_peer* peer;
+    char rate_string[10];
+    char data_string[40];
+    size_t prefix;
+    unsigned int j;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & PAGE_REDRAW) && displayed_version == cluster_version)
+        return result;
+    displayed_version = cluster_version;
+    prefix = cluster_name_prefix();
+    for (unsigned int i = 0; i < cluster_peers_count; i++) {
+        peer = &cluster_peers[i];
+        for (j = i; 0 < j && order[j - 1]->severity < peer->severity; j--)
+            order[j] = order[j - 1];
+        order[j] = peer;
+    }
+    for (unsigned int i = 1; i < DETAIL_LINES; i++) {
+        if (i - 1 < cluster_peers_count) {
+            peer = order[i - 1];
+            format_rate(rate_string, (long)peer->rx + peer->tx);
+            sprintf(data_string, "%-*.*s%4u%4u%4d%4u %s", CLUSTER_NAME_LENGHT, CLUSTER_NAME_LENGHT, peer->name + prefix, peer->cpu, peer->ram, peer->temp / 10, peer->fs, rate_string);
+            result += write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y + (i * DETAIL_LINE_STEP), data_string, DETAIL_LINE_LENGHT, alert_color(CLUSTER_ALERT <= peer->severity), window_color_code);
+        }
+        else if (i == 1)
+            result += display_detail_text(i, cluster_fd < 0 || !cluster_receive ? "Not receiving" : "No peers");
+        else
+            result += display_detail_text(i, "");
+    }
+
+    return result;
+}
+
+void compose_interrupts_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Ctxt", "CPU0", "CPU1", "CPU2", "CPU3", NULL, };
+
+    for (unsigned int i = softirqs_cpus; i < IRQ_CORE_LINES; i++)
+        labels[i + 1] = NULL;
+    compose_detail_page(buffer, "Interrupts", labels);
+}
+
+/* Context switches per second with the running and blocked tasks, then for each    */
+/* core its hard IRQ, softirq and NET_RX softirq rates, and the busiest IRQs on the */
+/* lines left.                                                                      */
+int update_interrupts_page(uint32_t updated) {
+    unsigned int cores = softirqs_cpus < IRQ_CORE_LINES ? softirqs_cpus : IRQ_CORE_LINES;
+    unsigned int top[DETAIL_LINES];
+    unsigned int top_count = 0;
+    char count_string[3][10];
+    char data_string[40];
+    unsigned int j;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & COLLECTOR_IRQ))
+        return result;
+    format_count(count_string[0], ctxt_rate);
+    sprintf(data_string, "%s/s run%3lld blk%3lld", count_string[0], proc_stat.values[PROC_STAT_RUNNING], proc_stat.values[PROC_STAT_BLOCKED]);
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y, data_string, DETAIL_VALUE_LENGHT, alert_color(metric_alert(METRIC_CTXT)), window_color_code);
+    for (unsigned int i = 0; i < cores; i++) {
+        format_count(count_string[0], irq_core_rates[i]);
+        format_count(count_string[1], softirq_core_rates[i]);
+        format_count(count_string[2], net_rx_core_rates[i]);
+        sprintf(data_string, "I%s S%s RX%s", count_string[0], count_string[1], count_string[2]);
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + ((i + 1) * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            alert_color(metric_alert(METRIC_NET_RX_SOFTIRQ) && net_rx_core_rates[i] == metric_net_rx_softirq()), window_color_code);
+    }
+    for (unsigned int i = 0; i < irqs_count; i++) {
+        if (irq_rates[i] < 1 || (top_count == DETAIL_LINES - 1 - cores && irq_rates[i] <= irq_rates[top[top_count - 1]]))
+            continue;
+        if (top_count < DETAIL_LINES - 1 - cores)
+            top_count++;
+        for (j = top_count - 1; 0 < j && irq_rates[top[j - 1]] < irq_rates[i]; j--)
+            top[j] = top[j - 1];
+        top[j] = i;
+    }
+    for (unsigned int i = 0; i < DETAIL_LINES - 1 - cores; i++) {
+        data_string[0] = '\0';
+        if (i < top_count) {
+            format_count(count_string[0], irq_rates[top[i]]);
+            sprintf(data_string, "%-5.5s%-16.16s %s", irq_ids[top[i]], irq_names[top[i]], count_string[0]);
+        }
+        result += display_detail_text(cores + 1 + i, data_string);
+    }
+
+    return result;
+}
+
+void compose_latency_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { NULL, };
+
+    for (unsigned int i = 0; i < probes_count; i++)
+        labels[i * 2] = probes[i].name;
+    compose_detail_page(buffer, "Latency", labels);
+}
+
+/* Two lines per target, the median and 99th percentile round trips of the recent  */
+/* probes, then the fastest one seen and the share of probes lost.                 */
+int update_latency_page(uint32_t updated) {
+    static unsigned int displayed_version = 0;
+    struct probe_target* probe;
+    char rtt_string[3][10];
+    char data_string[40];
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & PAGE_REDRAW) && displayed_version == probe_version)
+        return result;
+    displayed_version = probe_version;
+    if (probes_count == 0)
+        return result + display_detail_text(0, "No probe targets");
+    for (unsigned int i = 0; i < probes_count; i++) {
+        probe = &probes[i];
+        if (probe->rtt.total) {
+            format_rtt(rtt_string[0], histogram_quantile(&probe->rtt, 0.5));
+            format_rtt(rtt_string[1], histogram_quantile(&probe->rtt, 0.99));
+            format_rtt(rtt_string[2], probe->min_rtt);
+            sprintf(data_string, "p50 %s p99 %s", rtt_string[0], rtt_string[1]);
+        }
+        else
+            strcpy(data_string, probe->sent ? "No reply" : "Waiting");
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (i * 2 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            alert_color(metric_alert(METRIC_RTT) && probe->rtt.total && histogram_quantile(&probe->rtt, 0.5) / 1000.0 == metric_rtt()), window_color_code);
+        data_string[0] = '\0';
+        if (probe->sent)
+            sprintf(data_string, "min %s loss%4.0f%%", probe->rtt.total ? rtt_string[2] : "  - ", probe_loss(probe));
+        result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + ((i * 2 + 1) * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+            alert_color(probe->last_rtt == PROBE_LOST && probe->sent), window_color_code);
+    }
+
+    return result;
+}
+
+void compose_quantiles_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { NULL, };
+
+    compose_detail_page(buffer, "Quantiles", labels);
+}
+
+void format_quantile(char* data_string, double value) {
+    if (-9.95 < value && value < 9.95)
+        sprintf(data_string, "%4.1f", value);
+    else
+        format_count(data_string, value);
+}
+
+/* The metrics with samples in the window, seven at a time, each group is shown for */
+/* a few seconds before the next one and then the next window.                      */
+int update_quantiles_page(uint32_t updated) {
+    static unsigned int window = 0;
+    static unsigned int group = 0;
+    static time_t shown_time = 0;
+    time_t current_time = monotonic_time_ms() / 1000;
+    unsigned int shown[METRICS_COUNT];
+    unsigned int shown_count;
+    uint32_t counts[SKETCH_BUCKETS];
+    char value_strings[4][10];
+    char data_string[40];
+    double quantiles[4];
+    unsigned int line;
+    bool alert;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (updated & PAGE_REDRAW) {
+        window = 0;
+        group = 0;
+        shown_time = current_time;
+    }
+    else if (SKETCH_PAGE_TIME <= current_time - shown_time) {
+        group++;
+        shown_time = current_time;
+    }
+    shown_count = sampled_metrics(window, current_time, shown);
+    if (0 < group && shown_count <= group * (DETAIL_LINES - 1)) {
+        group = 0;
+        window = (window + 1) % SKETCH_WINDOWS;
+        shown_count = sampled_metrics(window, current_time, shown);
+    }
+    sprintf(data_string, "%-7s%4s %4s %4s %4s", sketch_windows[window], "p50", "p95", "p99", "max");
+    result += write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y, data_string, DETAIL_LINE_LENGHT, label_text_color_code, window_color_code);
+    for (unsigned int i = 0; i < DETAIL_LINES - 1; i++) {
+        data_string[0] = '\0';
+        alert = false;
+        line = group * (DETAIL_LINES - 1) + i;
+        if (line < shown_count) {
+            sketch_quantiles(counts, sketch_window(&sketches[shown[line]], window, current_time, counts), quantiles);
+            for (unsigned int j = 0; j < 4; j++)
+                format_quantile(value_strings[j], quantiles[j]);
+            sprintf(data_string, "%-7.7s%s %s %s %s", metrics[shown[line]].name, value_strings[0], value_strings[1], value_strings[2], value_strings[3]);
+            alert = metric_alert(shown[line]);
+        }
+        result += write_text_field(DETAIL_LINE_X, DETAIL_LINE_Y + ((i + 1) * DETAIL_LINE_STEP), data_string, DETAIL_LINE_LENGHT, alert_color(alert), window_color_code);
+    }
+
+    return result;
+}
+
+void compose_clock_page(uint16_t buffer[][SCREEN_WIDTH]) {
+    char* labels[DETAIL_LINES] = { "Sync", "Offset", "Error", "MaxErr", "Freq", "Hist", NULL, NULL, };
+
+    compose_detail_page(buffer, "Clock", labels);
+}
+
+void format_clock_ms(char* data_string, double value) {
+    if (-999.95 < value && value < 999.95)
+        sprintf(data_string, "%6.1f", value);
+    else if (-99999.5 < value && value < 99999.5)
+        sprintf(data_string, "%6.0f", value);
+    else
+        sprintf(data_string, "%5.0fs", value / 1000);
+}
+
+/* The synchronization and leap second state, the current offset with the estimated */
+/* and maximum errors, the frequency correction, then the offsets of the last nine   */
+/* minutes, newest first.                                                            */
+int update_clock_page(uint32_t updated) {
+    static const char* states[] = { "ok", "leap ins", "leap del", "leap now", "leap done", "error", };
+    char value_strings[3][10];
+    char data_string[40];
+    unsigned int line;
+    int result = 0;
+
+    result += display_time_info(data_text_color_code, window_color_code);
+    if (!(updated & (COLLECTOR_CLOCK | PAGE_REDRAW)))
+        return result;
+    sprintf(data_string, "%s %s", clock_status & STA_UNSYNC ? "unsynced" : "synced", TIME_OK <= clock_state && clock_state <= TIME_ERROR ? states[clock_state] : "?");
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y, data_string, DETAIL_VALUE_LENGHT,
+        alert_color(clock_state == TIME_ERROR || (clock_status & STA_UNSYNC)), window_color_code);
+    format_clock_ms(value_strings[0], clock_offset);
+    sprintf(data_string, "%s ms", value_strings[0]);
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + DETAIL_LINE_STEP, data_string, DETAIL_VALUE_LENGHT, alert_color(metric_alert(METRIC_CLOCK_OFFSET)), window_color_code);
+    format_clock_ms(value_strings[0], clock_estimated_error);
+    sprintf(data_string, "%s ms", value_strings[0]);
+    result += write_text_field(DETAIL_VALUE_X, DETAIL_LINE_Y + (2 * DETAIL_LINE_STEP), data_string, DETAIL_VALUE_LENGHT,
+        alert_color(clock_max_error < clock_estimated_error || metric_alert(METRIC_CLOCK_ERROR)), window_color_code);
+    format_clock_ms(value_strings[0], clock_maximum_error);
+    sprintf(data_string, "%s ms", value_strings[0]);
+    result += display_detail_value(3, data_string);
+    sprintf(data_string, "%+8.3f ppm", clock_frequency);
+    result += display_detail_value(4, data_string);
+    for (unsigned int i = 0; i < 3; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            line = i * 3 + j;
+            if (line < clock_history_count)
+                format_clock_ms(value_strings[j], clock_history[line]);
+            else
+                strcpy(value_strings[j], "     -");
+        }
+        sprintf(data_string, "%s %s %s", value_strings[0], value_strings[1], value_strings[2]);
+        result += display_detail_value(5 + i, data_string);
+    }
+
+    return result;
+}
+
+struct page pages[PAGE_COUNT] = {
+    { COLLECTOR_NET | COLLECTOR_CPU | COLLECTOR_RAM | COLLECTOR_TEMP | COLLECTOR_FREQ | COLLECTOR_UPTIME | COLLECTOR_FS | COLLECTOR_DISK | COLLECTOR_WIFI, compose_overview_page, update_overview_page, },
+    { COLLECTOR_NET | COLLECTOR_TCP | COLLECTOR_WIFI, compose_network_page, update_network_page, },
+    { COLLECTOR_FS | COLLECTOR_DISK, compose_disks_page, update_disks_page, },
+    { COLLECTOR_PROC, compose_processes_page, update_processes_page, true, },
+    { COLLECTOR_TEMP | COLLECTOR_FREQ, compose_thermal_page, update_thermal_page, },
+    { COLLECTOR_PSI | COLLECTOR_SCHED, compose_pressure_page, update_pressure_page, },
+    { 0, compose_events_page, update_events_page, },
+    { COLLECTOR_RAM, compose_memory_page, update_memory_page, },
+    { 0, compose_live_page, update_live_page, true, },
+    { COLLECTOR_CGROUP, compose_services_page, update_services_page, true, },
+    { 0, compose_cluster_page, update_cluster_page, true, },
+    { COLLECTOR_IRQ, compose_interrupts_page, update_interrupts_page, },
+    { 0, compose_latency_page, update_latency_page, },
+    { SKETCH_COLLECTORS, compose_quantiles_page, update_quantiles_page, },
+    { COLLECTOR_CLOCK, compose_clock_page, update_clock_page, },
+};
+
+struct collector collectors[] = {
+    { COLLECTOR_NET, collect_net_info, warm_net_info, NULL, 0, },
+    { COLLECTOR_CPU, collect_cpu_info, NULL, NULL, 0, },
+    { COLLECTOR_RAM, collect_ram_info, warm_ram_info, NULL, 0, },
+    { COLLECTOR_TEMP, collect_temp_info, NULL, NULL, 0, true, },
+    { COLLECTOR_UPTIME, collect_uptime_info, NULL, NULL, 0, true, },
+    { COLLECTOR_FS, collect_fs_info, NULL, &update_fs_time, 0, true, },
+    { COLLECTOR_PROC, collect_proc_info, warm_proc_info, NULL, 0, true, },
+    { COLLECTOR_FREQ, collect_freq_info, NULL, NULL, 0, true, },
+    { COLLECTOR_DISK, collect_disk_info, warm_disk_info, NULL, 0, },
+    { COLLECTOR_PSI, collect_psi_info, NULL, NULL, 0, },
+    { COLLECTOR_CGROUP, collect_cgroup_info, warm_cgroup_info, NULL, 0, true, },
+    { COLLECTOR_TCP, collect_tcp_info, warm_tcp_info, NULL, 0, },
+    { COLLECTOR_WIFI, collect_wifi_info, NULL, NULL, 0, },
+    { COLLECTOR_IRQ, collect_irq_info, warm_irq_info, NULL, 0, },
+    { COLLECTOR_PROBE, collect_probe_info, NULL, &probe_interval, 0, },
+    { COLLECTOR_CLOCK, collect_clock_info, NULL, NULL, 0, },
+    { COLLECTOR_SCHED, collect_sched_info, warm_sched_info, NULL, 0, },
+};
+
+#define COLLECTORS_COUNT        (sizeof(collectors) / sizeof(collectors[0]))
+
+/* Collectors not needed by the visible page are never scheduled. When a collector    */
+/* becomes active it is warmed up, so rates are not computed against stale counters.  */
+uint32_t activate_collectors(uint32_t mask, time_t current_time) {
+    uint32_t updated = 0;
+
+    for (size_t i = 0; i < COLLECTORS_COUNT; i++) {
+        if (!(mask & collectors[i].mask))
+            continue;
+        if (active_collectors & collectors[i].mask)
+            updated |= collectors[i].mask;
+        else {
+            if (collectors[i].warm != NULL)
+                collectors[i].warm();
+            else if (collectors[i].collect() == 0)
+                updated |= collectors[i].mask;
+            collectors[i].last_run = current_time;
+        }
+    }
+    active_collectors = mask;
+
+    return updated;
+}
+
+uint32_t run_collectors(time_t current_time) {
+    unsigned int interval;
+    uint32_t updated = 0;
+
+    for (size_t i = 0; i < COLLECTORS_COUNT; i++) {
+        if (!(active_collectors & collectors[i].mask))
+            continue;
+        interval = collectors[i].interval != NULL ? *collectors[i].interval : 0;
+        if (collectors[i].slow && interval < budget_slow_interval[budget_level])
+            interval = budget_slow_interval[budget_level];
+        if (interval && (current_time - collectors[i].last_run) < interval)
+            continue;
+        if (collectors[i].collect() == 0)
+            updated |= collectors[i].mask;
+        collectors[i].last_run = current_time;
+    }
+
+    return updated;
+}
+
+int show_page(unsigned int page) {
+    long long current_time = monotonic_time_ms();
+    uint32_t updated;
+    int result = 0;
+
+    current_page = page;
+    live_active = false;
+    if (startup_state != STARTUP_RUNNING)
+        return 0;
+    updated = activate_collectors(pages[page].collectors | SCREEN_COLLECTORS | alert_collectors, current_time / 1000);
+    /* Only the static layer of the visible page is kept, it is composed again on a */
+    /* page switch or when one of its inputs changes, and a redraw of the same page */
+    /* like a wake up only copies it before the value fields.                       */
+    if (page_background_page != page || page_background_version != background_version) {
+        memcpy(page_background, background_buffer, sizeof(background_buffer));
+        pages[page].compose(page_background);
+        page_background_page = page;
+        page_background_version = background_version;
+    }
+    if (panel_synced)
+        result += flush_changed_rows(page_background);
+    else
+        result += flush_buffer(page_background);
+    panel_synced = true;
+    result += pages[page].update(updated | PAGE_REDRAW);
+    screen_frames++;
+    next_tick_time = current_time + 1000;
+
+    return result;
+}
+
+void wake_screen(void) {
+    last_time = monotonic_time_ms() / 1000;
+    if (!update_screen) {
+        update_screen = true;
+        reset_awake_sketches();
+        if (panel_attached)
+            gpiod_line_set_value(st7789_backlight_pin, 1);
+        show_page(current_page);
+    }
+}
+
+bool add_daemon(char* name, char* pidfile) {
+    struct daemon* daemon = &daemons[daemons_count];
+
+    if (DAEMONS <= daemons_count)
+        return false;
+    snprintf(daemon->name, sizeof(daemon->name), "%s", name);
+    snprintf(daemon->pidfile, sizeof(daemon->pidfile), "%s", pidfile);
+    daemon->fd = -1;
+    daemon->sched_fd = -1;
+    daemon->backoff = 1;
+    daemons_count++;
+    return true;
+}
+
+/* The pid is read from the pidfile, or the first process with the daemon name is   */
+/* taken, the name being the one the kernel keeps, at most 15 characters.           */
+pid_t find_daemon_pid(struct daemon* daemon) {
+    struct dirent* entry;
+    char path[32];
+    char name[DAEMON_NAME_SIZE + 1];
+    pid_t pid = 0;
+    ssize_t size;
+    FILE* file;
+    DIR* dir;
+    int fd;
+
+    if (daemon->pidfile[0]) {
+        if ((file = fopen(daemon->pidfile, "r")) == NULL)
+            return 0;
+        if (fscanf(file, "%d", &pid) != 1 || pid <= 0)
+            pid = 0;
+        fclose(file);
+        return pid;
+    }
+    if ((dir = opendir("/proc")) == NULL)
+        return 0;
+    while (pid == 0 && (entry = readdir(dir)) != NULL) {
+        if (!isdigit(entry->d_name[0]))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            continue;
+        size = read(fd, name, sizeof(name) - 1);
+        close(fd);
+        if (size <= 0)
+            continue;
+        name[size - 1] = 0;
+        if (strcmp(name, daemon->name) == 0 && atoi(entry->d_name) != getpid())
+            pid = atoi(entry->d_name);
     }
+    closedir(dir);
 
-    sprintf(net_data_string, "%3ld%c", tx_bytes_diff, units);
-    result + write_text_to_display(buffer, FONT_HEIGHT * NET_DATA_WIDTH, net_data_string, NET_DATA_LENGHT, text_color, window_color, caset, raset);
+    return pid;
+}
 
-    return result;
+void schedule_daemons(void) {
+    daemon_retry_time = 0;
+    for (unsigned int i = 0; i < daemons_count; i++)
+        if (!daemons[i].up && (daemon_retry_time == 0 || daemons[i].retry_time < daemon_retry_time))
+            daemon_retry_time = daemons[i].retry_time;
 }
 
-char* skip_text(char* string_ptr, uint8_t n) {
-    for (uint8_t i = 0; i < n; i++) {
-        while (*string_ptr && *string_ptr != ' ')
-            string_ptr++;
-        while (*string_ptr && *string_ptr == ' ')
-            string_ptr++;
+void daemon_exit_event(int fd, short revents) {
+    char message[40];
+
+    for (unsigned int i = 0; i < daemons_count; i++) {
+        if (daemons[i].fd != fd)
+            continue;
+        poll_unregister(fd);
+        close(fd);
+        daemons[i].fd = -1;
+        daemons[i].up = false;
+        if (0 <= daemons[i].sched_fd)
+            close(daemons[i].sched_fd);
+        daemons[i].sched_fd = -1;
+        daemons[i].backoff = 1;
+        daemons[i].retry_time = monotonic_time_ms() + 1000;
+        daemon_version++;
+        snprintf(message, sizeof(message), "%s exited", daemons[i].name);
+        add_event(true, message);
+        schedule_daemons();
+        wake_screen();
+        return;
     }
-    return string_ptr;
 }
 
-int display_net_info(char* ifdev1, char* ifdev2, uint16_t text_color, uint16_t window_color) {
-    char net_data_string[300];
-    long rx_bytes;
-    long tx_bytes;
-    long rx_bytes_diff;
-    long tx_bytes_diff;
-    char* string_pointer;
-    FILE* filePointer;
-    int result = 0;
+/* A daemon is watched through a pidfd in the poll set, which becomes readable when */
+/* the process exits, so nothing is read while it runs. A daemon not found is looked */
+/* up again after a delay doubled on each miss, and counted as restarted when found  */
+/* again after an exit.                                                              */
+void start_daemon_watch(struct daemon* daemon, long long current_time) {
+    char message[40];
+    pid_t pid;
+    int fd = -1;
 
-    if ((filePointer = fopen("/proc/net/dev", "r")) != NULL) {
-        while (fgets(net_data_string, 299, filePointer) != NULL) {
-            string_pointer = skip_text(net_data_string, 1);
-            if (strncmp(ifdev1, string_pointer, strlen(ifdev1)) == 0) {
-                string_pointer = skip_text(string_pointer, 1);
-                rx_bytes = atol(string_pointer);
-                rx_bytes_diff = rx_bytes - rx_ifdev1_bytes;
-                rx_ifdev1_bytes = rx_bytes;
-                result += display_ifdev1_rx_info(rx_bytes_diff, text_color, window_color);
-                string_pointer = skip_text(string_pointer, 8);
-                tx_bytes = atol(string_pointer);
-                tx_bytes_diff = tx_bytes - tx_ifdev1_bytes;
-                tx_ifdev1_bytes = tx_bytes;
-                result += display_ifdev1_tx_info(tx_bytes_diff, text_color, window_color);
-            }
-            else if (strncmp(ifdev2, string_pointer, strlen(ifdev2)) == 0) {
-                string_pointer = skip_text(string_pointer, 1);
-                rx_bytes = atol(string_pointer);
-                rx_bytes_diff = rx_bytes - rx_ifdev2_bytes;
-                rx_ifdev2_bytes = rx_bytes;
-                result += display_ifdev2_rx_info(rx_bytes_diff, text_color, window_color);
-                string_pointer = skip_text(string_pointer, 8);
-                tx_bytes = atol(string_pointer);
-                tx_bytes_diff = tx_bytes - tx_ifdev2_bytes;
-                tx_ifdev2_bytes = tx_bytes;
-                result += display_ifdev2_tx_info(tx_bytes_diff, text_color, window_color);
-            }
-        }
-        fclose(filePointer);
+    if (0 < (pid = find_daemon_pid(daemon)) && (pid != daemon->pid || !daemon->started) && 0 <= (fd = syscall(SYS_pidfd_open, pid, 0))
+        && poll_register(fd, POLLIN, daemon_exit_event) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        daemon->retry_time = current_time + daemon->backoff * 1000LL;
+        daemon->backoff = daemon->backoff * 2 < DAEMON_BACKOFF_MAX ? daemon->backoff * 2 : DAEMON_BACKOFF_MAX;
+        return;
+    }
+    daemon->fd = fd;
+    daemon->pid = pid;
+    daemon->up = true;
+    daemon->timeslices = 0;
+    daemon->backoff = 1;
+    if (daemon->started) {
+        daemon->restarts++;
+        snprintf(message, sizeof(message), "%s restarted", daemon->name);
+        add_event(false, message);
     }
+    daemon->started = true;
+    daemon_version++;
+}
 
-    return result;
+void retry_daemons(long long current_time) {
+    for (unsigned int i = 0; i < daemons_count; i++)
+        if (!daemons[i].up && daemons[i].retry_time <= current_time)
+            start_daemon_watch(&daemons[i], current_time);
+    schedule_daemons();
 }
 
-int display_cpu_info(uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * CPU_DATA_WIDTH];
-    static uint8_t caset[] = { CPU_DATA_X1 >> 8, CPU_DATA_X1 & 0xff, CPU_DATA_X2 >> 8, (CPU_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { CPU_DATA_Y1 >> 8, CPU_DATA_Y1 & 0xff, CPU_DATA_Y2 >> 8, (CPU_DATA_Y2 - 1) & 0xff, };
-    char cpu_avg_string[10];
-    char cpu_string[10];
-    FILE* filePointer;
-    int result = 0;
+void daemon_open(void) {
+    char message[40];
 
-    if ((filePointer = fopen("/proc/loadavg", "r")) != NULL) {
-        if (fgets(cpu_avg_string, 9, filePointer) != NULL) {
-            sprintf(cpu_string, "%3d%%", (int)(atof(cpu_avg_string) * 100 / 4));
-            result + write_text_to_display(buffer, FONT_HEIGHT * CPU_DATA_WIDTH, cpu_string, CPU_DATA_LENGHT, text_color, window_color, caset, raset);
+    for (unsigned int i = 0; i < daemons_count; i++) {
+        start_daemon_watch(&daemons[i], monotonic_time_ms());
+        if (!daemons[i].up) {
+            snprintf(message, sizeof(message), "%s not running", daemons[i].name);
+            add_event(true, message);
         }
-        fclose(filePointer);
     }
-
-    return result;
+    schedule_daemons();
 }
 
-int display_ram_info(uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * RAM_DATA_WIDTH];
-    static uint8_t caset[] = { RAM_DATA_X1 >> 8, RAM_DATA_X1 & 0xff, RAM_DATA_X2 >> 8, (RAM_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { RAM_DATA_Y1 >> 8, RAM_DATA_Y1 & 0xff, RAM_DATA_Y2 >> 8, (RAM_DATA_Y2 - 1) & 0xff, };
-    char total_ram_string[30];
-    char free_ram_string[30];
-    char ram_string[10];
-    FILE* filePointer;
-    int result = 0;
-
-    if ((filePointer = fopen("/proc/meminfo", "r")) != NULL) {
-        if (fgets(total_ram_string, 30, filePointer) != NULL && fgets(free_ram_string, 30, filePointer) != NULL && fgets(free_ram_string, 30, filePointer) != NULL) {
-            char* total_ram = total_ram_string;
-            char* free_ram = free_ram_string;
-            while (*total_ram) {
-                if (isdigit(*total_ram))
-                    break;
-                total_ram++;
-            }
-            while (*free_ram) {
-                if (isdigit(*free_ram))
-                    break;
-                free_ram++;
-            }
-            sprintf(ram_string, "%3d%%", (int)(100 - (atol(free_ram) * 100 / atol(total_ram))));
-            result + write_text_to_display(buffer, FONT_HEIGHT * RAM_DATA_WIDTH, ram_string, RAM_DATA_LENGHT, text_color, window_color, caset, raset);
+void daemon_close(void) {
+    for (unsigned int i = 0; i < daemons_count; i++) {
+        if (0 <= daemons[i].fd) {
+            poll_unregister(daemons[i].fd);
+            close(daemons[i].fd);
         }
-        fclose(filePointer);
+        if (0 <= daemons[i].sched_fd)
+            close(daemons[i].sched_fd);
+        daemons[i].fd = -1;
+        daemons[i].sched_fd = -1;
     }
+    daemon_retry_time = 0;
+}
 
-    return result;
+/* The controller keeps the frame contents when the pixel format changes, so the    */
+/* switch requested with SIGUSR1 takes effect on a full redraw of the visible page. */
+void switch_color_depth(void) {
+    char message[40];
+
+    color_depth_switch = false;
+    color_depth = color_depth == 12 ? 16 : 12;
+    if (lcd_set_color_depth() < 0)
+        return;
+    snprintf(message, sizeof(message), "Panel switched to %u bit pixels", color_depth);
+    write_log("INFO", message);
+    panel_synced = false;
+    if (update_screen)
+        show_page(current_page);
 }
 
-int display_temp_info(uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * TEMP_DATA_WIDTH];
-    static uint8_t caset[] = { TEMP_DATA_X1 >> 8, TEMP_DATA_X1 & 0xff, TEMP_DATA_X2 >> 8, (TEMP_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { TEMP_DATA_Y1 >> 8, TEMP_DATA_Y1 & 0xff, TEMP_DATA_Y2 >> 8, (TEMP_DATA_Y2 - 1) & 0xff, };
-    char temp_string[10];
-    FILE* filePointer;
-    int result = 0;
+bool page_suspended(unsigned int page) {
+    return budget_level == BUDGET_LEVELS - 1 && pages[page].optional;
+}
 
-    if ((filePointer = fopen("/sys/class/thermal/thermal_zone0/temp", "r")) != NULL) {
-        if (fgets(temp_string, 9, filePointer) != NULL)
-            result + write_text_to_display(buffer, FONT_HEIGHT * TEMP_DATA_WIDTH, temp_string, TEMP_DATA_LENGHT, text_color, window_color, caset, raset);
-        fclose(filePointer);
+unsigned int next_page(unsigned int page) {
+    do
+        page = (page + 1) % PAGE_COUNT;
+    while (page_suspended(page));
+    return page;
+}
+
+/* Once per minute the CPU time used by the process, threads included, is compared  */
+/* with the budget. Over the budget the refresh steps down one level, the slow      */
+/* changing collectors run less often and the live page is limited, and on the last */
+/* level the optional pages are suspended. Below half the budget it steps back up,  */
+/* so the level doesn't flap around the threshold.                                  */
+void check_cpu_budget(long long current_time) {
+    struct rusage usage;
+    unsigned int level = budget_level;
+    long long cpu_time;
+    char message[40];
+
+    if (cpu_budget <= 0 || trace_replaying || current_time < budget_check_time + BUDGET_INTERVAL * 1000 || getrusage(RUSAGE_SELF, &usage) < 0)
+        return;
+    cpu_time = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    if (budget_check_time) {
+        budget_usage = (cpu_time - budget_cpu_time) / ((current_time - budget_check_time) * 10.0);
+        if (cpu_budget < budget_usage && level < BUDGET_LEVELS - 1)
+            level++;
+        else if (budget_usage < cpu_budget / 2 && 0 < level)
+            level--;
     }
+    budget_cpu_time = cpu_time;
+    budget_check_time = current_time;
+    if (level == budget_level)
+        return;
 
-    return result;
+    snprintf(message, sizeof(message), "CPU L%u %.2f%%/%.2f%%", level, budget_usage, cpu_budget);
+    add_event(budget_level < level, message);
+    budget_level = level;
+    if (page_suspended(current_page)) {
+        if (update_screen)
+            show_page(PAGE_OVERVIEW);
+        else
+            current_page = PAGE_OVERVIEW;
+    }
 }
 
-int display_uptime_info(uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * UPT_DATA_WIDTH];
-    static uint8_t caset[] = { UPT_DATA_X1 >> 8, UPT_DATA_X1 & 0xff, UPT_DATA_X2 >> 8, (UPT_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { UPT_DATA_Y1 >> 8, UPT_DATA_Y1 & 0xff, UPT_DATA_Y2 >> 8, (UPT_DATA_Y2 - 1) & 0xff, };
-    char uptime_data_string[30];
-    char uptime_string[11];
-    FILE* filePointer;
-    time_t uptime;
-    int result = 0;
+void show_user_page(unsigned int page) {
+    if (!update_screen) {
+        current_page = page;
+        wake_screen();
+    }
+    else
+        show_page(page);
+    last_time = monotonic_time_ms() / 1000;
+}
 
-    if ((filePointer = fopen("/proc/uptime", "r")) != NULL) {
-        if (fgets(uptime_data_string, 30, filePointer) != NULL) {
-            uptime = atol(uptime_data_string);
-            int d = (uptime / (24 * 3600));
-            uptime %= (24 * 3600);
-            int h = (uptime / 3600);
-            uptime %= 3600;
-            if (0 < d)
-                sprintf(uptime_string, "%3d:%02d:%02dD", d, h, (uptime / 60));
-            else
-                sprintf(uptime_string, " %02d:%02d:%02dH", h, (uptime / 60), (uptime % 60));
-            result + write_text_to_display(buffer, FONT_HEIGHT * UPT_DATA_WIDTH, uptime_string, UPT_DATA_LENGHT, text_color, window_color, caset, raset);
-        }
-        fclose(filePointer);
+/* A short press cycles the pages and a long press goes back to the overview, the     */
+/* duration is measured between the kernel timestamps of the falling and rising edge. */
+void user_button_event(int fd, short revents) {
+    static struct timespec pressed_time;
+    static bool pressed = false;
+    struct gpiod_line_event event;
+    unsigned int page;
+    long duration;
+
+    if (gpiod_line_event_read(user_button_pin, &event) < 0) {
+        write_error("Failed to read user button event");
+        return;
+    }
+    if (event.event_type == GPIOD_LINE_EVENT_FALLING_EDGE) {
+        pressed_time = event.ts;
+        pressed = true;
+        return;
     }
+    if (!pressed)
+        return;
+    pressed = false;
+    duration = (event.ts.tv_sec - pressed_time.tv_sec) * 1000 + (event.ts.tv_nsec - pressed_time.tv_nsec) / 1000000;
+    if (duration < BUTTON_DEBOUNCE_TIME)
+        return;
 
-    return result;
+    page = !update_screen ? current_page : long_press_time <= duration ? PAGE_OVERVIEW : next_page(current_page);
+    trace_event(TRACE_PAGE, page);
+    show_user_page(page);
 }
 
-int display_fs1_info(char* fs1, uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * FS1_DATA_WIDTH];
-    static uint8_t caset[] = { FS1_DATA_X1 >> 8, FS1_DATA_X1 & 0xff, FS1_DATA_X2 >> 8, (FS1_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { FS1_DATA_Y1 >> 8, FS1_DATA_Y1 & 0xff, FS1_DATA_Y2 >> 8, (FS1_DATA_Y2 - 1) & 0xff, };
-    struct statvfs stat;
-    char fs1_string[10];
-    int result = 0;
+void psi_trigger_fired(int resource) {
+    psi_events[resource]++;
+    psi_alert_time[resource] = monotonic_time_ms() / 1000;
+    wake_screen();
+}
 
-    if (statvfs(fs1, &stat) == 0) {
-        sprintf(fs1_string, "%3d%%", ((stat.f_blocks - stat.f_bfree) * 100 / stat.f_blocks));
-        result + write_text_to_display(buffer, FONT_HEIGHT * FS1_DATA_WIDTH, fs1_string, FS1_DATA_LENGHT, text_color, window_color, caset, raset);
+/* The kernel signals POLLPRI on a trigger fd when the stall time inside the window  */
+/* crosses the threshold, nothing is read or polled between events.                  */
+void psi_trigger_event(int fd, short revents) {
+    for (int i = 0; i < PSI_RESOURCES; i++) {
+        if (psi_trigger_fds[i] != fd)
+            continue;
+        /* POLLERR stays raised once the trigger is gone, it would wake every poll. */
+        if (revents & POLLERR) {
+            write_error("Pressure stall trigger is no longer available");
+            poll_unregister(fd);
+            close(fd);
+            psi_trigger_fds[i] = -1;
+            return;
+        }
+        trace_event(TRACE_PSI, i);
+        psi_trigger_fired(i);
     }
+}
 
-    return result;
+void psi_open_triggers(void) {
+    for (int i = 0; i < PSI_RESOURCES; i++) {
+        if (psi_triggers[i][0] == 0 || strcmp(psi_triggers[i], "off") == 0)
+            continue;
+        if ((psi_trigger_fds[i] = open(psi_files[i], O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+            write_error("Failed to open pressure stall file");
+            continue;
+        }
+        if (write(psi_trigger_fds[i], psi_triggers[i], strlen(psi_triggers[i]) + 1) < 0 || poll_register(psi_trigger_fds[i], POLLPRI, psi_trigger_event) < 0) {
+            write_error("Failed to register pressure stall trigger");
+            close(psi_trigger_fds[i]);
+            psi_trigger_fds[i] = -1;
+        }
+    }
 }
 
-int display_fs2_info(char* fs2, uint16_t text_color, uint16_t window_color) {
-    static uint16_t buffer[FONT_HEIGHT * FS2_DATA_WIDTH];
-    static uint8_t caset[] = { FS2_DATA_X1 >> 8, FS2_DATA_X1 & 0xff, FS2_DATA_X2 >> 8, (FS2_DATA_X2 - 1) & 0xff, };
-    static uint8_t raset[] = { FS2_DATA_Y1 >> 8, FS2_DATA_Y1 & 0xff, FS2_DATA_Y2 >> 8, (FS2_DATA_Y2 - 1) & 0xff, };
-    struct statvfs stat;
-    char fs2_string[10];
-    int result = 0;
+bool discover_ip_addresses(void) {
+    char address[INET_ADDRSTRLEN];
+    bool changed = false;
+    struct ifaddrs* ptr_ifaddrs;
+    struct ifaddrs* ptr_entry;
 
-    if (statvfs(fs2, &stat) == 0) {
-        sprintf(fs2_string, "%3d%%", ((stat.f_blocks - stat.f_bfree) * 100 / stat.f_blocks));
-        result + write_text_to_display(buffer, FONT_HEIGHT * FS2_DATA_WIDTH, fs2_string, FS2_DATA_LENGHT, text_color, window_color, caset, raset);
+    if (getifaddrs(&ptr_ifaddrs) != 0) {
+        write_error("Unable to get the network interfaces");
+        return false;
+    }
+    for (ptr_entry = ptr_ifaddrs; ptr_entry != NULL; ptr_entry = ptr_entry->ifa_next) {
+        if (ptr_entry->ifa_addr == NULL || ptr_entry->ifa_addr->sa_family != AF_INET)
+            continue;
+        inet_ntop(AF_INET, &((struct sockaddr_in*)(ptr_entry->ifa_addr))->sin_addr, address, INET_ADDRSTRLEN);
+        if (check_ifdev1 && strcmp(ptr_entry->ifa_name, ifdev1_id) == 0 && (!ifdev1_ready || strcmp(ifdev1_address, address) != 0)) {
+            strcpy(ifdev1_address, address);
+            ifdev1_ready = changed = true;
+        }
+        if (check_ifdev2 && strcmp(ptr_entry->ifa_name, ifdev2_id) == 0 && (!ifdev2_ready || strcmp(ifdev2_address, address) != 0)) {
+            strcpy(ifdev2_address, address);
+            ifdev2_ready = changed = true;
+        }
     }
+    freeifaddrs(ptr_ifaddrs);
 
-    return result;
+    if (changed)
+        background_version++;
+    if (changed && update_screen && (current_page == PAGE_OVERVIEW || current_page == PAGE_NETWORK || current_page == PAGE_LIVE))
+        show_page(current_page);
+    return (!check_ifdev1 || ifdev1_ready) && (!check_ifdev2 || ifdev2_ready);
 }
 
-int warm_net_info(char* ifdev1, char* ifdev2) {
-    char net_data_string[300];
-    char* string_pointer;
-    FILE* filePointer;
-    int result = 0;
+/* The kernel notifies every IPv4 address change through netlink, the addresses are */
+/* read again only then. Without netlink they are polled on each tick.              */
+void ip_address_event(int fd, short revents) {
+    char buffer[4096];
 
-    if ((filePointer = fopen("/proc/net/dev", "r")) != NULL) {
-        while (fgets(net_data_string, 299, filePointer) != NULL) {
-            string_pointer = skip_text(net_data_string, 1);
-            if (strncmp(ifdev1, string_pointer, strlen(ifdev1)) == 0) {
-                string_pointer = skip_text(string_pointer, 1);
-                rx_ifdev1_bytes = atol(string_pointer);
-                string_pointer = skip_text(string_pointer, 8);
-                tx_ifdev1_bytes = atol(string_pointer);
-            }
-            else if (strncmp(ifdev2, string_pointer, strlen(ifdev2)) == 0) {
-                string_pointer = skip_text(string_pointer, 1);
-                rx_ifdev2_bytes = atol(string_pointer);
-                string_pointer = skip_text(string_pointer, 8);
-                tx_ifdev2_bytes = atol(string_pointer);
-            }
+    while (0 < recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT));
+    discover_ip_addresses();
+}
+
+void start_ip_discovery(void) {
+    struct sockaddr_nl address = { .nl_family = AF_NETLINK, .nl_groups = RTMGRP_IPV4_IFADDR, };
+
+    ip_discovery_deadline = monotonic_time_ms() + IP_DISCOVERY_TIMEOUT * 1000;
+    if (0 <= (ip_netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE))) {
+        if (bind(ip_netlink_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || poll_register(ip_netlink_fd, POLLIN, ip_address_event) < 0) {
+            close(ip_netlink_fd);
+            ip_netlink_fd = -1;
         }
-        fclose(filePointer);
     }
+    discover_ip_addresses();
+}
 
-    return result;
+void check_ip_discovery(long long current_time) {
+    char* not_ready = "Device not ready";
+    bool changed = false;
+
+    if (!ip_discovery_deadline)
+        return;
+    if (ip_netlink_fd < 0 ? discover_ip_addresses() : (!check_ifdev1 || ifdev1_ready) && (!check_ifdev2 || ifdev2_ready)) {
+        ip_discovery_deadline = 0;
+        return;
+    }
+    if (current_time < ip_discovery_deadline)
+        return;
+    ip_discovery_deadline = 0;
+    if (check_ifdev1 && !ifdev1_ready) {
+        strcpy(ifdev1_address, not_ready);
+        changed = true;
+    }
+    if (check_ifdev2 && !ifdev2_ready) {
+        strcpy(ifdev2_address, not_ready);
+        changed = true;
+    }
+    if (changed)
+        background_version++;
+    if (changed && update_screen && (current_page == PAGE_OVERVIEW || current_page == PAGE_NETWORK || current_page == PAGE_LIVE))
+        show_page(current_page);
 }
 
-void buffer_write_string(uint16_t buffer[][SCREEN_WIDTH], uint16_t x, uint16_t y, char* string_ptr, uint16_t text_color, uint16_t window_color) {
-    while (*string_ptr) {
-        for (uint16_t i = 0; i < FONT_HEIGHT && (y + i) < SCREEN_HEIGHT; i++) {
-            uint16_t char_row = font[(*string_ptr) - 31][i];
-            for (uint16_t j = 0; j < FONT_WIDTH && (x + j) < SCREEN_WIDTH; j++)
-                buffer[y + i][x + j] = (char_row << j) & 0x8000 ? text_color : window_color;
+/* Startup goes on inside the main loop, the reset line was pulled low when the GPIO */
+/* lines were requested, then it is released and the init sequence and the first    */
+/* frame are sent once the controller is ready.                                     */
+void startup_step(long long current_time) {
+    char message[60];
+
+    if (startup_state == STARTUP_RESET) {
+        if (gpiod_line_set_value(st7789_reset_pin, 1) < 0) {
+            write_error("Failed to reset the screen");
+            service_running = false;
+            return;
         }
-        x += FONT_WIDTH;
-        string_ptr++;
+        startup_state = STARTUP_WAKE;
+        startup_deadline = current_time + LCD_RESET_TIME;
+        return;
     }
+    if (lcd_screen_init() != 0)
+        panel_fault("Panel init failed");
+    else
+        start_panel_check();
+    startup_state = STARTUP_RUNNING;
+    show_page(current_page);
+    first_frame_time = monotonic_time_ms() - start_time;
+    sprintf(message, "First full frame %lld ms after start", first_frame_time);
+    write_log("INFO", message);
 }
 
-void buffer_write_h_line(uint16_t buffer[][SCREEN_WIDTH], uint16_t x1, uint16_t x2, uint16_t y, uint16_t color) {
-    for (int i = x1; i < x2;i++)
-        buffer[y][i] = color;
+/* The recovery goes through the same steps as the startup, then the panel is      */
+/* restored from the screen buffer, without composing the page again.             */
+void panel_recovery_step(long long current_time) {
+    char message[EVENT_TEXT_SIZE];
+
+    if (panel_state == PANEL_FAILED) {
+        close(spidev_fd);
+        data_pin_level = -1;
+        if (lcd_screen_open() < 0 || gpiod_line_set_value(st7789_reset_pin, 0) < 0) {
+            panel_recovery_failures++;
+            panel_state = PANEL_OK;
+            panel_fault("Panel reset failed");
+            return;
+        }
+        panel_state = PANEL_RESET;
+        panel_recovery_time = current_time + LCD_RESET_TIME;
+        return;
+    }
+    if (panel_state == PANEL_RESET) {
+        gpiod_line_set_value(st7789_reset_pin, 1);
+        panel_state = PANEL_WAKE;
+        panel_recovery_time = current_time + LCD_RESET_TIME;
+        return;
+    }
+    panel_state = PANEL_OK;
+    spi_consecutive_errors = 0;
+    if (lcd_screen_init() != 0 || flush_buffer(screen_buffer) != 0 || panel_state != PANEL_OK) {
+        panel_recovery_failures++;
+        panel_fault("Panel recovery failed");
+        return;
+    }
+    panel_recovery_time = 0;
+    panel_backoff = 1;
+    panel_recoveries++;
+    panel_recovery_duration = current_time - panel_fault_time;
+    snprintf(message, sizeof(message), "Panel back in %lld ms", panel_recovery_duration);
+    add_event(false, message);
 }
 
-void buffer_write_rectangle(uint16_t buffer[][SCREEN_WIDTH], uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color) {
-    buffer_write_h_line(buffer, x + 4, x + w - 4, y, color);
-    buffer_write_h_line(buffer, x + 3, x + w - 3, y + 1, color);
-    buffer_write_h_line(buffer, x + 2, x + w - 2, y + 2, color);
-    buffer_write_h_line(buffer, x + 1, x + w - 1, y + 3, color);
-    for (int j = y + 4; j < y + h - 4; j++)
-        buffer_write_h_line(buffer, x, x + w, j, color);
-    buffer_write_h_line(buffer, x + 1, x + w - 1, y + h - 4, color);
-    buffer_write_h_line(buffer, x + 2, x + w - 2, y + h - 3, color);
-    buffer_write_h_line(buffer, x + 3, x + w - 3, y + h - 2, color);
-    buffer_write_h_line(buffer, x + 4, x + w - 4, y + h - 1, color);
+void update_tick(void) {
+    time_t current_time;
+    uint32_t updated;
+
+    trace_event(TRACE_TICK, 0);
+    current_time = monotonic_time_ms() / 1000;
+    check_ip_discovery(monotonic_time_ms());
+    check_cpu_budget(monotonic_time_ms());
+    updated = run_collectors(current_time);
+    sample_metrics(updated, current_time);
+    cluster_tick(current_time);
+    if (evaluate_alerts(updated, current_time) && !update_screen) {
+        wake_screen();
+        return;
+    }
+    if (!update_screen)
+        return;
+    check_panel_status(current_time);
+    pages[current_page].update(updated);
+    screen_frames++;
+    if (sleep_after < (current_time - last_time)) {
+        update_screen = false;
+        activate_collectors(alert_collectors, current_time);
+        if (panel_attached)
+            gpiod_line_set_value(st7789_backlight_pin, 0);
+    }
 }
 
-int flush_buffer(uint16_t buffer[][SCREEN_WIDTH]) {
-    static uint8_t caset[] = { 0x00, 0x00, SCREEN_WIDTH >> 8, (SCREEN_WIDTH - 1) & 0xff, };
-    static uint8_t raset[] = { 0x00, 0x00, SCREEN_HEIGHT >> 8, (SCREEN_HEIGHT - 1) & 0xff, };
-    int result = 0;
+void process_events(long long until) {
+    long long current_time;
+    long long wait;
+    bool ticking;
 
-    result += spi_write_register(ST7789_CASET, caset, 4);
-    result += spi_write_register(ST7789_RASET, raset, 4);
-    result += spi_write_register(ST7789_RAMWR, NULL, 0);
-    for (uint16_t index = 0; index < 40; index++)
-        result += spi_transfer((uint8_t*)(buffer)+(index * 1920 * 2), 1920 * 2);
+    while (service_running && (current_time = monotonic_time_ms()) < until) {
+        if (startup_state != STARTUP_RUNNING && startup_deadline <= current_time) {
+            startup_step(current_time);
+            continue;
+        }
+        if (color_depth_switch && startup_state == STARTUP_RUNNING) {
+            switch_color_depth();
+            continue;
+        }
+        if (stats_dump_request) {
+            dump_stats();
+            continue;
+        }
+        if (panel_state != PANEL_OK && startup_state == STARTUP_RUNNING && panel_recovery_time <= current_time) {
+            panel_recovery_step(current_time);
+            continue;
+        }
+        if (daemon_retry_time && daemon_retry_time <= current_time) {
+            retry_daemons(current_time);
+            continue;
+        }
+        ticking = startup_state == STARTUP_RUNNING && (update_screen || alert_collectors);
+        if (ticking && next_tick_time <= current_time) {
+            update_tick();
+            next_tick_time += 1000;
+            if (next_tick_time <= current_time)
+                next_tick_time = current_time + 1000;
+            continue;
+        }
+        if (update_screen && live_active && next_frame_time <= current_time) {
+            live_frame(current_time);
+            continue;
+        }
+        rfb_send_updates();
+        wait = until - current_time;
+        if (startup_state != STARTUP_RUNNING && startup_deadline - current_time < wait)
+            wait = startup_deadline - current_time;
+        if (ticking && next_tick_time - current_time < wait)
+            wait = next_tick_time - current_time;
+        if (update_screen && live_active && next_frame_time - current_time < wait)
+            wait = next_frame_time - current_time;
+        if (panel_state != PANEL_OK && panel_recovery_time - current_time < wait)
+            wait = panel_recovery_time - current_time;
+        if (daemon_retry_time && daemon_retry_time - current_time < wait)
+            wait = daemon_retry_time - current_time;
+        if (0 < poll(poll_fds, poll_fds_count, wait < INT_MAX ? (int)wait : -1))
+            poll_dispatch();
+    }
+}
 
-    return result;
+void start_collectors(void) {
+    char message[80];
+
+    trace_event(TRACE_START, 0);
+    snprintf(message, sizeof(message), "Quantile sketches of %zu metrics use %zu KB", METRICS_COUNT, sizeof(sketches) / 1024);
+    write_log("INFO", message);
+    for (unsigned int i = 0; i < alerts_count; i++)
+        alert_collectors |= metrics[alerts[i].metric].collector;
+    if (0 <= cluster_fd)
+        alert_collectors |= CLUSTER_COLLECTORS;
+    if (probes_count)
+        alert_collectors |= COLLECTOR_PROBE;
+    activate_collectors(pages[current_page].collectors | SCREEN_COLLECTORS | alert_collectors, monotonic_time_ms() / 1000);
 }
 
-int display_fixed_info(char* ifdev1, char* ifdev2, char* fs1, char* fs2, uint16_t data_text_color, uint16_t fixed_text_color, uint16_t label_text_color, uint16_t window_color, uint16_t background_color) {
-    uint16_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH];
-    char* not_ready = "Device not ready";
-    char* waiting = "Waiting...";
-    bool ifdev1_ready = false;
-    bool ifdev2_ready = false;
-    struct ifaddrs* ptr_ifaddrs;
-    struct ifaddrs* ptr_entry;
-    struct statvfs stat;
-    char data_string[30];
-    uint8_t retry = 0;
-    int result = 0;
+void update_status(void) {
+    compose_background();
+    last_time = monotonic_time_ms() / 1000;
+    if (poll_register(gpiod_line_event_get_fd(user_button_pin), POLLIN, user_button_event) < 0)
+        return;
+    psi_open_triggers();
+    rfb_open();
+    cluster_open();
+    probe_open();
+    daemon_open();
+    start_collectors();
+    start_ip_discovery();
+    process_events(LLONG_MAX);
+    rfb_stop();
+    cluster_close();
+    probe_close();
+    daemon_close();
+}
 
-    for (uint16_t i = 0; i < SCREEN_HEIGHT; i++)
-        for (uint16_t j = 0; j < SCREEN_WIDTH; j++)
-            buffer[i][j] = background_color;
+/* Serves the VNC viewers until the given time, without running the collectors. */
+void replay_wait(long long until) {
+    long long wait;
 
-    buffer_write_rectangle(buffer, SQUARE1_X, SQUARE1_Y, SQUARE1_W, SQUARE1_H, window_color);
-    buffer_write_rectangle(buffer, SQUARE2_X, SQUARE2_Y, SQUARE2_W, SQUARE2_H, window_color);
-    buffer_write_rectangle(buffer, SQUARE3_X, SQUARE3_Y, SQUARE3_W, SQUARE3_H, window_color);
-    buffer_write_rectangle(buffer, SQUARE4_X, SQUARE4_Y, SQUARE4_W, SQUARE4_H, window_color);
+    do {
+        rfb_send_updates();
+        wait = (until - monotonic_time_us()) / 1000;
+        if (0 < poll(poll_fds, poll_fds_count, 0 < wait ? (int)wait : 0))
+            poll_dispatch();
+    } while (service_running && monotonic_time_us() < until);
+}
 
-    if (gethostname(data_string, 30) == 0)
-        buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(data_string) / 2), NAME_DATA_Y1, data_string, fixed_text_color, window_color);
+/* Replays the ticks, live frames and user actions of a trace through the same      */
+/* collectors and pages, the reads are served from the trace and the clocks follow  */
+/* the recorded times. It runs as fast as possible or at the recorded pace, on the  */
+/* panel when it can be opened and on the VNC viewers.                              */
+void replay_trace(void) {
+    struct trace_record record;
+    struct stat file_stat;
+    size_t offset = sizeof(TRACE_MAGIC) - 1;
+    size_t next = offset;
+    long long replay_start = monotonic_time_us();
+    long long clock_base = monotonic_time_ms();
+    long long first_time = -1;
+    long long tick_time = 0;
+    unsigned int ticks = 0;
+    char message[100];
+    bool gpio_ready;
+    int fd;
 
-    if (check_ifdev1) {
-        buffer_write_string(buffer, NET1_LABEL_X, NET1_LABEL_Y, ifdev1, label_text_color, window_color);
-        buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(waiting) / 2), NET1_DATA_Y, waiting, fixed_text_color, window_color);
-        buffer_write_string(buffer, NET_LABEL_RX_X, NET1_LABEL_Y, "RX", label_text_color, window_color);
-        buffer_write_string(buffer, NET_LABEL_TX_X, NET1_LABEL_Y, "TX", label_text_color, window_color);
+    if ((fd = open(trace_replay_file, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &file_stat) < 0 || file_stat.st_size < (off_t)offset ||
+        (trace_data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        write_error("Failed to open the trace file");
+        if (0 <= fd)
+            close(fd);
+        return;
     }
-
-    if (check_ifdev2) {
-        buffer_write_string(buffer, NET2_LABEL_X, NET2_LABEL_Y, ifdev2, label_text_color, window_color);
-        buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(waiting) / 2), NET2_DATA_Y, waiting, fixed_text_color, window_color);
-        buffer_write_string(buffer, NET_LABEL_RX_X, NET2_LABEL_Y, "RX", label_text_color, window_color);
-        buffer_write_string(buffer, NET_LABEL_TX_X, NET2_LABEL_Y, "TX", label_text_color, window_color);
-    }
-
-    buffer_write_string(buffer, CPU_LABEL_X1, CPU_DATA_Y1, "CPU", label_text_color, window_color);
-    buffer_write_string(buffer, RAM_LABEL_X1, RAM_DATA_Y1, "RAM", label_text_color, window_color);
-    buffer_write_string(buffer, TEMP_LABEL_X1, TEMP_DATA_Y1, "Temp", label_text_color, window_color);
-    buffer_write_string(buffer, TEMP_FIXED_X1, TEMP_DATA_Y1, "\x1f", data_text_color, window_color);
-    buffer_write_string(buffer, UPT_LABEL_X1, UPT_DATA_Y1, "UpT", label_text_color, window_color);
-    buffer_write_string(buffer, FS1_LABEL_X1, FS1_DATA_Y1, "FS1", label_text_color, window_color);
-    buffer_write_string(buffer, FS2_LABEL_X1, FS2_DATA_Y1, "FS2", label_text_color, window_color);
-
-    if (statvfs(fs1, &stat) == 0) {
-        double fs_size = (double)(stat.f_blocks * stat.f_frsize) / (1024.0 * 1024.0);
-        char size_label = 'M';
-        if (100 < fs_size) {
-            fs_size /= 1024.0;
-            size_label = 'G';
-        }
-        if (100 < fs_size) {
-            fs_size /= 1024.0;
-            size_label = 'T';
-        }
-        sprintf(data_string, "%3.1f%c", fs_size, size_label);
-        buffer_write_string(buffer, FS1_FIXED_X1, FS1_DATA_Y1, data_string, fixed_text_color, window_color);
-        check_sda = true;
+    close(fd);
+    trace_size = file_stat.st_size;
+    if (memcmp(trace_data, TRACE_MAGIC, offset) != 0) {
+        write_log("ERROR", "Invalid trace file");
+        munmap((void*)trace_data, trace_size);
+        return;
     }
-    else
-        buffer_write_string(buffer, FS1_FIXED_X1, FS1_DATA_Y1, "N/A", fixed_text_color, window_color);
 
-    if (statvfs(fs2, &stat) == 0) {
-        double fs_size = (double)(stat.f_blocks * stat.f_frsize) / (1024.0 * 1024.0);
-        char size_label = 'M';
-        if (100 < fs_size) {
-            fs_size /= 1024.0;
-            size_label = 'G';
+    gpio_ready = gpio_open() == 0;
+    panel_attached = gpio_ready && lcd_screen_open() == 0;
+    if (!panel_attached)
+        write_log("INFO", "Replaying the trace without the panel");
+    compose_background();
+    rfb_open();
+    trace_replaying = true;
+    while (service_running && offset + sizeof(record) <= trace_size) {
+        memcpy(&record, trace_data + offset, sizeof(record));
+        if ((next = trace_next(offset)) == 0)
+            break;
+        trace_block_start = trace_cursor = trace_block_end = next;
+        if (record.kind == TRACE_READ) {
+            offset = trace_block_end;
+            continue;
         }
-        if (100 < fs_size) {
-            fs_size /= 1024.0;
-            size_label = 'T';
+        while (trace_block_end + sizeof(record) <= trace_size && trace_data[trace_block_end + offsetof(struct trace_record, kind)] == TRACE_READ) {
+            if ((next = trace_next(trace_block_end)) == 0)
+                break;
+            trace_block_end = next;
         }
-        sprintf(data_string, "%3.1f%c", fs_size, size_label);
-        buffer_write_string(buffer, FS2_FIXED_X1, FS2_DATA_Y1, data_string, fixed_text_color, window_color);
-        check_sdb = true;
-    }
-    else
-        buffer_write_string(buffer, FS2_FIXED_X1, FS2_DATA_Y1, "N/A", fixed_text_color, window_color);
-
-    result += flush_buffer(buffer);
-
-    while (retry < 120) {
-        sleep(1);
-        if (getifaddrs(&ptr_ifaddrs) == 0) {
-            ptr_entry = ptr_ifaddrs;
-            while (ptr_entry != NULL) {
-                if (ptr_entry->ifa_addr->sa_family == AF_INET) {
-                    if (strcmp(ptr_entry->ifa_name, ifdev1) == 0) {
-                        if (ptr_entry->ifa_addr != NULL) {
-                            char ip_address[INET_ADDRSTRLEN] = { 0, };
-                            inet_ntop(ptr_entry->ifa_addr->sa_family, &((struct sockaddr_in*)(ptr_entry->ifa_addr))->sin_addr, ip_address, INET_ADDRSTRLEN);
-                            buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(ip_address) / 2), NET1_DATA_Y, ip_address, fixed_text_color, window_color);
-                            ifdev1_ready = true;
-                        }
-                        else
-                            buffer_write_string(buffer, NET1_DATA_X, NET1_DATA_Y, "IP Address N/A", fixed_text_color, window_color);
-                    }
-
-                    if (strcmp(ptr_entry->ifa_name, ifdev2) == 0) {
-                        if (ptr_entry->ifa_addr != NULL) {
-                            char ip_address[INET_ADDRSTRLEN] = { 0, };
-                            inet_ntop(ptr_entry->ifa_addr->sa_family, &((struct sockaddr_in*)(ptr_entry->ifa_addr))->sin_addr, ip_address, INET_ADDRSTRLEN);
-                            buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(ip_address) / 2), NET2_DATA_Y, ip_address, fixed_text_color, window_color);
-                            ifdev2_ready = true;
-                        }
-                        else
-                            buffer_write_string(buffer, NET2_DATA_X, NET2_DATA_Y, "IP Address N/A", fixed_text_color, window_color);
-                    }
-                }
-                ptr_entry = ptr_entry->ifa_next;
+        if (next == 0)
+            break;
+        if (first_time < 0)
+            first_time = record.time;
+        replay_wait(trace_replay_pace ? replay_start + (record.time - first_time) * 1000LL : 0);
+        trace_clock = clock_base + record.time - first_time;
+        if (record.length == sizeof(trace_wall_time))
+            memcpy(&trace_wall_time, trace_data + offset + sizeof(record) + record.path_length, sizeof(trace_wall_time));
+
+        if (record.kind == TRACE_START) {
+            last_time = trace_clock / 1000;
+            start_collectors();
+            if (panel_attached) {
+                usleep(LCD_RESET_TIME * 1000);
+                startup_step(trace_clock);
+                usleep(LCD_RESET_TIME * 1000);
+                startup_step(trace_clock);
             }
-            if ((check_ifdev1 && ifdev1_ready && check_ifdev2 && ifdev2_ready) || (!check_ifdev1 && check_ifdev2 && ifdev2_ready) || (check_ifdev1 && ifdev1_ready && !check_ifdev2))
-                break;
             else {
-                display_time_info(data_text_color, window_color);
-                display_net_info(ifdev1, ifdev2, data_text_color, window_color);
-                display_cpu_info(data_text_color, window_color);
-                display_ram_info(data_text_color, window_color);
-                display_temp_info(data_text_color, window_color);
-                display_uptime_info(data_text_color, window_color);
-                display_fs1_info(fs1, data_text_color, window_color);
-                display_fs2_info(fs2, data_text_color, window_color);
+                startup_state = STARTUP_RUNNING;
+                show_page(current_page);
             }
         }
-        else
-            write_error("Unable to get the network interfaces");
-        retry++;
+        else if (startup_state != STARTUP_RUNNING)
+            ;
+        else if (record.kind == TRACE_TICK) {
+            tick_time -= monotonic_time_us();
+            update_tick();
+            tick_time += monotonic_time_us();
+            ticks++;
+        }
+        else if (record.kind == TRACE_FRAME && update_screen && live_active)
+            live_frame(trace_clock);
+        else if (record.kind == TRACE_PAGE && record.value < PAGE_COUNT)
+            show_user_page(record.value);
+        else if (record.kind == TRACE_PSI && record.value < PSI_RESOURCES)
+            psi_trigger_fired(record.value);
+        offset = trace_block_end;
     }
+    trace_replaying = false;
+    if (next == 0)
+        write_log("ERROR", "Invalid trace file");
+    snprintf(message, sizeof(message), "Replayed %u ticks in %lld ms, %lld us and %lld SPI bytes per tick", ticks, (monotonic_time_us() - replay_start) / 1000,
+        ticks ? tick_time / ticks : 0, ticks ? spi_bytes / ticks : 0);
+    write_log("INFO", message);
 
-    if (check_ifdev1 && !ifdev1_ready)
-        buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(not_ready) / 2), NET1_DATA_Y, not_ready, fixed_text_color, window_color);
-
-    if (check_ifdev2 && !ifdev2_ready)
-        buffer_write_string(buffer, (FONT_WIDTH * MAX_CHARS_IN_LINE / 2) - (FONT_WIDTH * strlen(not_ready) / 2), NET2_DATA_Y, not_ready, fixed_text_color, window_color);
-
-    result += flush_buffer(buffer);
-    return result;
+    rfb_stop();
+    munmap((void*)trace_data, trace_size);
+    if (panel_attached)
+        lcd_screen_close();
+    if (gpio_ready)
+        gpio_close();
 }
 
-void update_status(char* ifdev1, char* ifdev2, char* fs1, char* fs2, uint16_t data_text_color, uint16_t fixed_text_color, uint16_t label_text_color, uint16_t window_color, uint16_t background_color) {
-    struct timespec ts;
-    time_t current_time, previouse_time = 0;
-    long nanoseconds, diff = 500;
-
-    timespec_get(&ts, TIME_UTC);
-    last_time = current_time = ts.tv_sec;
-    nanoseconds = ts.tv_nsec;
-    warm_net_info(ifdev1, ifdev2);
-    display_fixed_info(ifdev1, ifdev2, fs1, fs2, data_text_color, fixed_text_color, label_text_color, window_color, background_color);
-    while (service_running) {
-        if (update_screen) {
-            display_time_info(data_text_color, window_color);
-            display_net_info(ifdev1, ifdev2, data_text_color, window_color);
-            display_cpu_info(data_text_color, window_color);
-            display_ram_info(data_text_color, window_color);
-            display_temp_info(data_text_color, window_color);
-            display_uptime_info(data_text_color, window_color);
-            if (update_fs_time < (current_time - previouse_time)) {
-                if (check_sda)
-                    display_fs1_info(fs1, data_text_color, window_color);
-                if (check_sdb)
-                    display_fs2_info(fs2, data_text_color, window_color);
-                previouse_time = current_time;
-            }
-            if (sleep_after < (current_time - last_time)) {
-                update_screen = false;
-                gpiod_line_set_value(st7789_backlight_pin, 0);
-            }
+bool set_panel_layout(char* name) {
+    for (size_t i = 0; i < sizeof(panel_layouts) / sizeof(panel_layouts[0]); i++) {
+        if (strcmp(panel_layouts[i].name, name) == 0) {
+            layout = &panel_layouts[i];
+            return true;
         }
-        timespec_get(&ts, TIME_UTC);
-        diff = (abs((ts.tv_nsec - nanoseconds) / 1000) + diff) / 2;
-        current_time = ts.tv_sec;
-        nanoseconds = ts.tv_nsec;
-        usleep(1000000 - diff);
     }
+    return false;
 }
 
 void load_config(char* config_file_path) {
     char config_string[300];
+    char metric_name[32];
+    char cgroup_path[128];
+    char panel_name[16];
+    char probe_name[PROBE_NAME_SIZE];
+    char probe_address[16];
+    char daemon_name[DAEMON_NAME_SIZE];
+    char daemon_pidfile[128];
+    unsigned int probe_port;
+    int count;
+    struct alert alert = { 0, };
     FILE* filePointer;
     if ((filePointer = fopen(config_file_path, "r")) != NULL) {
         check_ifdev1 = false;
@@ -1222,37 +6793,172 @@ void load_config(char* config_file_path) {
             if (sscanf(config_string, "colors = %4hx %4hx %4hx %4hx %4hx", &data_text_color_code, &fixed_text_color_code, &label_text_color_code, &window_color_code, &background_color_code) == 5) {
                 continue;
             }
+            if (sscanf(config_string, "alert_color = %4hx", &alert_color_code) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "psi_cpu_trigger = %99[^\n]", psi_triggers[PSI_CPU]) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "psi_memory_trigger = %99[^\n]", psi_triggers[PSI_MEMORY]) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "psi_io_trigger = %99[^\n]", psi_triggers[PSI_IO]) == 1) {
+                continue;
+            }
+            if ((count = sscanf(config_string, "probe = %15s %15s %u", probe_name, probe_address, &probe_port)) >= 2) {
+                if (!add_probe(probe_name, probe_address, count == 3 ? probe_port : 0))
+                    write_error("Invalid probe definition");
+                continue;
+            }
+            if (sscanf(config_string, "stats_file = %254s", stats_file) == 1) {
+                continue;
+            }
+            if ((count = sscanf(config_string, "daemon = %15s %127s", daemon_name, daemon_pidfile)) >= 1) {
+                if (!add_daemon(daemon_name, count == 2 ? daemon_pidfile : ""))
+                    write_error("Too many daemons");
+                continue;
+            }
+            if (sscanf(config_string, "panel_check_interval = %u", &panel_check_interval) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "clock_max_error = %lf", &clock_max_error) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "probe_interval = %u", &probe_interval) == 1) {
+                if (probe_interval == 0)
+                    probe_interval = 1;
+                continue;
+            }
+            if (sscanf(config_string, "cgroup = %127s", cgroup_path) == 1) {
+                add_cgroup(cgroup_path);
+                continue;
+            }
+            if (sscanf(config_string, "alert = %31s %lf %lf %u", metric_name, &alert.threshold, &alert.clear, &alert.duration) == 4) {
+                if (alerts_count < MAX_ALERTS && 0 <= (alert.metric = find_metric(metric_name)))
+                    alerts[alerts_count++] = alert;
+                else
+                    write_error("Invalid alert definition");
+                continue;
+            }
             if (sscanf(config_string, "update_fs_time = %u", &update_fs_time) == 1) {
                 continue;
             }
             if (sscanf(config_string, "sleep_after = %u", &sleep_after) == 1) {
                 continue;
             }
+            if (sscanf(config_string, "color_depth = %u", &color_depth) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "panel = %15s", panel_name) == 1) {
+                if (!set_panel_layout(panel_name))
+                    write_error("Unknown panel geometry");
+                continue;
+            }
+            if (sscanf(config_string, "panel_rotation = %u", &panel_rotation) == 1) {
+                if (panel_rotation != 0 && panel_rotation != 180) {
+                    write_error("Panel rotation must be 0 or 180");
+                    panel_rotation = 180;
+                }
+                continue;
+            }
+            if (sscanf(config_string, "panel_offset_x = %d", &panel_offset_x) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "panel_offset_y = %d", &panel_offset_y) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "long_press_time = %u", &long_press_time) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "live_rate = %u", &live_rate) == 1) {
+                if (LIVE_MAX_RATE < live_rate)
+                    live_rate = LIVE_MAX_RATE;
+                continue;
+            }
+            if (sscanf(config_string, "live_frame_budget = %u", &live_frame_budget) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "live_timeout = %u", &live_timeout) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cpu_budget = %lf", &cpu_budget) == 1) {
+                continue;
+            }
             if (sscanf(config_string, "log_file = %s", log_file) == 1) {
                 continue;
             }
+            if (sscanf(config_string, "vnc_port = %u", &vnc_port) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "vnc_socket = %107s", vnc_socket) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cluster_group = %15s", cluster_group) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cluster_port = %u", &cluster_port) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cluster_interval = %u", &cluster_interval) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cluster_receive = %u", &cluster_receive) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "cluster_name = %16s", cluster_name) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "log_max_size = %u", &log_max_size) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "log_journal = %u", &log_journal) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "trace_record = %127s", trace_record_file) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "trace_replay = %127s", trace_replay_file) == 1) {
+                continue;
+            }
+            if (sscanf(config_string, "trace_replay_pace = %u", &trace_replay_pace) == 1) {
+                continue;
+            }
         }
         fclose(filePointer);
     }
 }
 
 int main(int argc, char* argv[]) {
-    pthread_t user_button_read_thread_id;
+    start_time = monotonic_time_ms();
     signal(SIGINT, signals_handler);
     signal(SIGTERM, signals_handler);
+    signal(SIGUSR1, signals_handler);
+    signal(SIGUSR2, signals_handler);
 
     if (1 < argc)
         load_config(argv[1]);
+    /* The timezone is read once, localtime_r does not look at it again. */
+    tzset();
+    log_open();
 
+    if ((clock_ticks = sysconf(_SC_CLK_TCK)) <= 0)
+        clock_ticks = 100;
+
+    if (trace_replay_file[0]) {
+        replay_trace();
+        log_close();
+        return 0;
+    }
+    trace_open();
     if (gpio_open() == 0) {
         if (lcd_screen_open() == 0) {
-            if (pthread_create(&user_button_read_thread_id, NULL, user_button_read_thread, NULL) == 0)
-                pthread_detach(user_button_read_thread_id);
-            update_status(ifdev1_id, ifdev2_id, fs1_id, fs2_id, data_text_color_code, fixed_text_color_code, label_text_color_code, window_color_code, background_color_code);
+            update_status();
             lcd_screen_close();
         }
         gpio_close();
     }
+    trace_close();
+    log_close();
 
     return 0;
 }
\ No newline at end of file